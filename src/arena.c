@@ -0,0 +1,67 @@
+// NOTE: Reserves and touches all memory up front, so no page is faulted in
+// later while a frame is running. Huge pages are tried first, they have to
+// be set aside by the system (vm.nr_hugepages), otherwise the kernel is asked
+// for transparent huge pages. Returns 0 if there is no memory at all.
+static int
+init_game_memory(game_memory *memory, size_t permanent_size, size_t transient_size) {
+    *memory = (game_memory) {};
+
+    size_t size = permanent_size + transient_size;
+    size = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+
+    void *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    base = mmap(0, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    memory->has_huge_pages = base != MAP_FAILED;
+#endif
+
+    if (base == MAP_FAILED) {
+        base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            logerr("Failed to reserve %zu bytes of memory\n", size);
+            return 0;
+        }
+
+#ifdef MADV_HUGEPAGE
+        madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    // NOTE: One write per page, after the advice so the kernel can back the
+    // range with huge pages right away
+    for (size_t offset = 0; offset < size; offset += 4096) {
+        ((volatile u8 *)base)[offset] = 0;
+    }
+
+    memory->base = (u8 *)base;
+    memory->size = size;
+
+    init_arena(&memory->permanent, "permanent", memory->base, permanent_size);
+    init_arena(&memory->transient, "transient", memory->base + permanent_size,
+               size - permanent_size);
+
+    SDL_Log("Reserved %zu KB of memory%s\n", size / 1024,
+            memory->has_huge_pages ? " in huge pages" : "");
+
+    return 1;
+}
+
+// NOTE: The permanent arena only grows during startup, so after that its use
+// is the whole footprint of the game besides the transient high water mark.
+static void
+report_memory_usage(game_memory *memory) {
+    SDL_Log("memory       permanent %8zu KB of %8zu KB, transient peak %6zu KB of %6zu KB\n",
+            memory->permanent.used / 1024, memory->permanent.size / 1024,
+            memory->transient.high_water / 1024, memory->transient.size / 1024);
+}
+
+static void
+close_game_memory(game_memory *memory) {
+    if (memory->base) {
+        munmap(memory->base, memory->size);
+    }
+
+    *memory = (game_memory) {};
+}
@@ -0,0 +1,72 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// NOTE: All memory the game uses comes out of one reservation made at
+// startup. The permanent arena holds everything that lives as long as the
+// game, the transient arena is reset at the start of every frame and holds
+// scratch data that does not outlive it. Nothing is ever freed on its own.
+typedef struct {
+    const char *name;
+    u8 *base;
+    size_t size;
+    size_t used;
+    // NOTE: The most that was ever in use, across resets
+    size_t high_water;
+} memory_arena;
+
+typedef struct {
+    u8 *base;
+    size_t size;
+    i32 has_huge_pages;
+
+    memory_arena permanent;
+    memory_arena transient;
+} game_memory;
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+static inline void
+init_arena(memory_arena *arena, const char *name, u8 *base, size_t size) {
+    *arena = (memory_arena) {};
+
+    arena->name = name;
+    arena->base = base;
+    arena->size = size;
+}
+
+// NOTE: Memory straight from the reservation is zero, memory handed out
+// again after a reset is not. Running out is a sizing bug, so it is fatal.
+static inline void *
+push_size(memory_arena *arena, size_t size, size_t alignment) {
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+
+    if (offset + size > arena->size) {
+        logerr("The %s arena is out of memory, %zu bytes requested with %zu of %zu in use\n",
+               arena->name, size, arena->used, arena->size);
+        abort();
+    }
+
+    arena->used = offset + size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+
+    void *result = arena->base + offset;
+    return result;
+}
+
+#define push_struct(arena, type) \
+    ((type *)push_size(arena, sizeof(type), _Alignof(type)))
+#define push_array(arena, count, type) \
+    ((type *)push_size(arena, (size_t)(count) * sizeof(type), _Alignof(type)))
+// NOTE: For pixel buffers and other data that is walked with SIMD
+#define push_buffer(arena, size) \
+    ((u8 *)push_size(arena, size, ARENA_DEFAULT_ALIGNMENT))
+
+static inline void
+reset_arena(memory_arena *arena) {
+    arena->used = 0;
+}
+
+#endif
@@ -0,0 +1,229 @@
+// NOTE: A square wave with a linear fade out, good enough for blips
+static void
+make_tone(sound *s, memory_arena *arena, f32 frequency, f32 duration, f32 amplitude) {
+    s->sample_count = (u32)(duration * AUDIO_SAMPLE_RATE);
+    s->samples = push_array(arena, s->sample_count, i16);
+
+    u32 period = (u32)(AUDIO_SAMPLE_RATE / frequency);
+    for (u32 i = 0; i < s->sample_count; ++i) {
+        f32 envelope = 1.0f - (f32)i / s->sample_count;
+        f32 value = (i % period) < period / 2 ? amplitude : -amplitude;
+        s->samples[i] = (i16)(value * envelope * 32767.0f);
+    }
+}
+
+// NOTE: out[i] = saturate(out[i] + samples[i] * volume), the volume is Q15
+static void
+mix_samples_scalar(i16 *out, i16 *samples, u32 count, i16 volume) {
+    for (u32 i = 0; i < count; ++i) {
+        i32 scaled = ((samples[i] * volume) >> 16) * 2;
+        i32 value = out[i] + scaled;
+        if (value > 32767) { value = 32767; }
+        if (value < -32768) { value = -32768; }
+        out[i] = (i16)value;
+    }
+}
+
+// NOTE: Same results as mix_samples_scalar bit for bit, on every backend
+static void
+mix_samples(i16 *out, i16 *samples, u32 count, i16 volume) {
+    u32 i = 0;
+
+#if MATH_SSE2
+    __m128i v = _mm_set1_epi16(volume);
+    for (; i + 8 <= count; i += 8) {
+        __m128i s = _mm_loadu_si128((__m128i *)(samples + i));
+        __m128i o = _mm_loadu_si128((__m128i *)(out + i));
+        __m128i scaled = _mm_slli_epi16(_mm_mulhi_epi16(s, v), 1);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_adds_epi16(o, scaled));
+    }
+#elif MATH_NEON
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t s = vld1q_s16(samples + i);
+        int16x8_t o = vld1q_s16(out + i);
+        // NOTE: The full product shifted down by 16 like the scalar path,
+        // vqdmulhq would give (2 * s * v) >> 16 which differs in the last bit
+        int32x4_t lo = vshrq_n_s32(vmull_n_s16(vget_low_s16(s), volume), 16);
+        int32x4_t hi = vshrq_n_s32(vmull_n_s16(vget_high_s16(s), volume), 16);
+        int16x8_t scaled = vshlq_n_s16(vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)), 1);
+        vst1q_s16(out + i, vqaddq_s16(o, scaled));
+    }
+#endif
+
+    mix_samples_scalar(out + i, samples + i, count - i, volume);
+}
+
+static void
+start_voice(audio_state *audio, audio_command *command) {
+    if (command->sound >= SOUND_COUNT) {
+        return;
+    }
+
+    voice *v;
+    if (audio->voice_count < AUDIO_MAX_VOICE_COUNT) {
+        v = audio->voices + audio->voice_count++;
+    } else {
+        // NOTE: Steal the voice that has played the longest
+        v = audio->voices;
+        for (u32 i = 1; i < audio->voice_count; ++i) {
+            if (audio->voices[i].position > v->position) {
+                v = audio->voices + i;
+            }
+        }
+    }
+
+    v->sound = audio->sounds + command->sound;
+    v->position = 0;
+    v->volume = command->volume;
+}
+
+// NOTE: Runs on SDL's audio thread
+static void
+audio_callback(void *userdata, u8 *stream, int len) {
+    u64 begin = SDL_GetPerformanceCounter();
+
+    audio_state *audio = userdata;
+    i16 *out = (i16 *)stream;
+    u32 sample_count = len / sizeof(i16);
+
+    memset(stream, 0, len);
+
+    u32 read_index = atomic_load_explicit(&audio->command_read_index, memory_order_relaxed);
+    u32 write_index = atomic_load_explicit(&audio->command_write_index, memory_order_acquire);
+    // NOTE: Taken after the acquire so every visible command is older
+    u64 now = SDL_GetPerformanceCounter();
+    u64 max_wait = 0;
+    for (; read_index != write_index; ++read_index) {
+        audio_command *command = audio->commands + (read_index & (AUDIO_COMMAND_RING_SIZE - 1));
+
+        u64 wait = now - command->trigger_ticks;
+        if (wait > max_wait) {
+            max_wait = wait;
+        }
+
+        start_voice(audio, command);
+    }
+    atomic_store_explicit(&audio->command_read_index, read_index, memory_order_release);
+
+    for (u32 i = 0; i < audio->voice_count;) {
+        voice *v = audio->voices + i;
+
+        u32 count = v->sound->sample_count - v->position;
+        if (count > sample_count) {
+            count = sample_count;
+        }
+
+        mix_samples(out, v->sound->samples + v->position, count, v->volume);
+        v->position += count;
+
+        if (v->position == v->sound->sample_count) {
+            *v = audio->voices[--audio->voice_count];
+        } else {
+            ++i;
+        }
+    }
+
+    u64 ticks = SDL_GetPerformanceCounter() - begin;
+    atomic_fetch_add_explicit(&audio->mix_ticks, ticks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&audio->callback_count, 1, memory_order_relaxed);
+    if (ticks > atomic_load_explicit(&audio->max_mix_ticks, memory_order_relaxed)) {
+        atomic_store_explicit(&audio->max_mix_ticks, ticks, memory_order_relaxed);
+    }
+    if (max_wait > atomic_load_explicit(&audio->max_trigger_wait_ticks, memory_order_relaxed)) {
+        atomic_store_explicit(&audio->max_trigger_wait_ticks, max_wait, memory_order_relaxed);
+    }
+}
+
+// NOTE: Opens the default device. Setting SDL_AUDIODRIVER to dummy or disk
+// runs the mixer without any sound hardware. Returns 0 if there is no audio,
+// the game runs on silently.
+static int
+init_audio(audio_state *audio, memory_arena *arena) {
+    *audio = (audio_state) {};
+
+    make_tone(audio->sounds + SOUND_BLOCK_HIT, arena, 880.0f, 0.08f, 0.5f);
+    make_tone(audio->sounds + SOUND_PADDLE_HIT, arena, 440.0f, 0.10f, 0.5f);
+    make_tone(audio->sounds + SOUND_WALL_HIT, arena, 220.0f, 0.05f, 0.4f);
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        logerr("Failed to initialize audio: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_AudioSpec want = {};
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_BUFFER_SAMPLES;
+    want.callback = audio_callback;
+    want.userdata = audio;
+
+    // NOTE: No allowed changes, SDL converts if the device differs
+    SDL_AudioSpec have;
+    audio->device = SDL_OpenAudioDevice(0, 0, &want, &have, 0);
+    if (!audio->device) {
+        logerr("Failed to open audio device: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    audio->sample_rate = have.freq;
+    audio->buffer_samples = have.samples;
+
+    SDL_Log("Audio driver %s, %u samples per buffer\n",
+            SDL_GetCurrentAudioDriver(), audio->buffer_samples);
+
+    SDL_PauseAudioDevice(audio->device, 0);
+    return 1;
+}
+
+static void
+close_audio(audio_state *audio) {
+    if (audio->device) {
+        SDL_CloseAudioDevice(audio->device);
+        audio->device = 0;
+    }
+}
+
+// NOTE: Called from the game thread only. Never blocks or allocates, the
+// sound is dropped if the ring is full.
+static void
+play_sound(audio_state *audio, sound_id id, f32 volume) {
+    u32 write_index = atomic_load_explicit(&audio->command_write_index, memory_order_relaxed);
+    u32 read_index = atomic_load_explicit(&audio->command_read_index, memory_order_acquire);
+
+    if (write_index - read_index >= AUDIO_COMMAND_RING_SIZE) {
+        atomic_fetch_add_explicit(&audio->dropped_command_count, 1, memory_order_relaxed);
+        return;
+    }
+
+    audio_command *command = audio->commands + (write_index & (AUDIO_COMMAND_RING_SIZE - 1));
+    command->sound = id;
+    command->volume = (i16)(volume * 32767.0f);
+    command->trigger_ticks = SDL_GetPerformanceCounter();
+
+    atomic_store_explicit(&audio->command_write_index, write_index + 1, memory_order_release);
+}
+
+// NOTE: The worst case latency from play_sound to the speaker is the longest
+// wait for a callback plus the buffer the sound was mixed into.
+static void
+report_audio_stats(audio_state *audio) {
+    if (!audio->device) {
+        return;
+    }
+
+    u64 mix_ticks = atomic_exchange_explicit(&audio->mix_ticks, 0, memory_order_relaxed);
+    u64 max_mix_ticks = atomic_exchange_explicit(&audio->max_mix_ticks, 0, memory_order_relaxed);
+    u32 callback_count = atomic_exchange_explicit(&audio->callback_count, 0, memory_order_relaxed);
+    u64 max_wait_ticks = atomic_exchange_explicit(&audio->max_trigger_wait_ticks, 0, memory_order_relaxed);
+    u32 dropped = atomic_exchange_explicit(&audio->dropped_command_count, 0, memory_order_relaxed);
+
+    if (callback_count) {
+        f64 buffer_us = audio->buffer_samples * 1000000.0 / audio->sample_rate;
+        SDL_Log("%-12s avg %9.2fus max %9.2fus hits %6u\n",
+                "mixer", ticks_to_us(mix_ticks) / callback_count,
+                ticks_to_us(max_mix_ticks), callback_count);
+        SDL_Log("%-12s max %9.2fus dropped %u\n",
+                "latency", ticks_to_us(max_wait_ticks) + buffer_us, dropped);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#define AUDIO_SAMPLE_RATE 48000
+#define AUDIO_BUFFER_SAMPLES 512
+#define AUDIO_MAX_VOICE_COUNT 32
+// NOTE: Must be a power of two
+#define AUDIO_COMMAND_RING_SIZE 64
+
+typedef enum {
+    SOUND_BLOCK_HIT,
+    SOUND_PADDLE_HIT,
+    SOUND_WALL_HIT,
+
+    SOUND_COUNT,
+} sound_id;
+
+// NOTE: Mono, signed 16 bit at AUDIO_SAMPLE_RATE
+typedef struct {
+    i16 *samples;
+    u32 sample_count;
+} sound;
+
+typedef struct {
+    u32 sound;
+    // NOTE: Q15, 32767 is full volume
+    i16 volume;
+    // NOTE: SDL_GetPerformanceCounter when the game asked for the sound
+    u64 trigger_ticks;
+} audio_command;
+
+typedef struct {
+    sound *sound;
+    u32 position;
+    i16 volume;
+} voice;
+
+// NOTE: The game thread is the only producer of the command ring and the
+// audio callback the only consumer, so the indices are the only shared
+// state and neither side ever takes a lock.
+typedef struct {
+    audio_command commands[AUDIO_COMMAND_RING_SIZE];
+    _Atomic u32 command_write_index;
+    _Atomic u32 command_read_index;
+
+    // NOTE: Owned by the audio callback
+    sound sounds[SOUND_COUNT];
+    voice voices[AUDIO_MAX_VOICE_COUNT];
+    u32 voice_count;
+
+    // NOTE: Written by the audio callback, read and reset by the game
+    _Atomic u64 mix_ticks;
+    _Atomic u64 max_mix_ticks;
+    _Atomic u32 callback_count;
+    _Atomic u64 max_trigger_wait_ticks;
+    _Atomic u32 dropped_command_count;
+
+    SDL_AudioDeviceID device;
+    u32 sample_rate;
+    u32 buffer_samples;
+} audio_state;
+
+#endif
@@ -1,7 +1,40 @@
 #include "breakout.h"
+#include "arena.c"
 #include "renderer.c"
+#include "snapshot.c"
+#include "sprite.c"
+#include "text.c"
+#include "audio.c"
+#include "capture.c"
 
 #define MAX_ENTITY_COUNT 1024
+#define MAX_COLLISION_EVENT_COUNT 256
+#define START_LIVES 3
+
+#define REWIND_BUFFER_SIZE (8 * 1024 * 1024)
+
+// NOTE: Sized for the rewind buffer, the game states, the render targets and
+// the capture pool at the window size, with room to spare. The transient
+// arena only holds per-frame scratch data.
+#define PERMANENT_MEMORY_SIZE (64 * 1024 * 1024)
+#define TRANSIENT_MEMORY_SIZE (4 * 1024 * 1024)
+#define CHECKPOINT_PATH "breakout.checkpoint"
+
+// NOTE: Relative to the build directory, which run.sh starts the game from
+#define DATA_PATH "../data/"
+
+// NOTE: Size of the playing field in world units
+#define WORLD_WIDTH 800.0f
+#define WORLD_HEIGHT 600.0f
+
+// NOTE: The full internal resolution, independent of the window size. It is
+// lowered at runtime by dynamic resolution scaling.
+#define RENDER_WIDTH 800
+#define RENDER_HEIGHT 600
+
+// NOTE: Budget for update and rendering, which leaves room for the texture
+// upload and present within a 60Hz frame
+#define FRAME_BUDGET_US 12000.0
 
 typedef enum {
     ENTITY_TYPE_BLOCK,
@@ -9,6 +42,8 @@ typedef enum {
     ENTITY_TYPE_BALL,
     ENTITY_TYPE_BALL_TAIL,
     ENTITY_TYPE_WALL,
+
+    ENTITY_TYPE_COUNT,
 } entity_type;
 
 enum {
@@ -25,6 +60,12 @@ typedef struct {
     vec2 vel;
 } entity;
 
+typedef struct {
+    u32 mover_index;
+    u32 hit_index;
+    vec2 normal;
+} collision_event;
+
 typedef struct {
     u32 entity_count;
     entity entities[MAX_ENTITY_COUNT];
@@ -32,9 +73,89 @@ typedef struct {
     u32 free_entity_index_count;
     u32 free_entity_indices[MAX_ENTITY_COUNT];
 
-    entity *player_paddle;
+    // NOTE: The state must not hold pointers so that it stays valid when
+    // copied around by snapshots, rewinds and checkpoints.
+    u32 player_paddle_index;
+
+    u32 score;
+    u32 lives;
 } game_state;
 
+// NOTE: Structural changes made during a tick are deferred to the sync point
+// in apply_entity_commands, so the entity array is never mutated while it is
+// iterated. Pushed on the transient arena for every tick, so none of it ends
+// up in snapshots.
+typedef struct {
+    u32 spawned_entity_count;
+    entity spawned_entities[MAX_ENTITY_COUNT];
+
+    u32 removed_entity_index_count;
+    u32 removed_entity_indices[MAX_ENTITY_COUNT];
+
+    // NOTE: Filled by move_entity, so gameplay code and the audio can consume
+    // the whole batch after the update
+    u32 collision_event_count;
+    collision_event collision_events[MAX_COLLISION_EVENT_COUNT];
+} tick_commands;
+
+static void
+save_game_state(game_state *gs, game_state *snapshot) {
+    memcpy(snapshot, gs, sizeof(game_state));
+}
+
+static void
+restore_game_state(game_state *gs, game_state *snapshot) {
+    memcpy(gs, snapshot, sizeof(game_state));
+}
+
+// NOTE: Only the live part of the state is snapshotted, the entities past
+// entity_count and the unused end of the free list are always written before
+// they are read again.
+static u32
+get_game_state_ranges(game_state *gs, state_range *ranges) {
+    ranges[0].offset = 0;
+    ranges[0].size = offsetof(game_state, entities) + gs->entity_count * sizeof(entity);
+
+    ranges[1].offset = offsetof(game_state, free_entity_index_count);
+    ranges[1].size = offsetof(game_state, free_entity_indices) - ranges[1].offset +
+                     gs->free_entity_index_count * sizeof(u32);
+
+    ranges[2].offset = offsetof(game_state, player_paddle_index);
+    ranges[2].size = sizeof(game_state) - ranges[2].offset;
+
+    u32 result = 3;
+    return result;
+}
+
+// NOTE: Changes whenever a field of the state moves or changes size, so a
+// checkpoint of another build is not resumed from even when nobody bumped
+// CHECKPOINT_VERSION. hash_pixels is a plain FNV-1a over u32s.
+static u32
+get_game_state_layout_hash(void) {
+    u32 layout[] = {
+        MAX_ENTITY_COUNT,
+        sizeof(entity),
+        offsetof(entity, index),
+        offsetof(entity, type),
+        offsetof(entity, flags),
+        offsetof(entity, pos),
+        offsetof(entity, size),
+        offsetof(entity, vel),
+        sizeof(game_state),
+        offsetof(game_state, entity_count),
+        offsetof(game_state, entities),
+        offsetof(game_state, free_entity_index_count),
+        offsetof(game_state, free_entity_indices),
+        offsetof(game_state, player_paddle_index),
+        offsetof(game_state, score),
+        offsetof(game_state, lives),
+    };
+
+    u64 hash = hash_pixels(layout, count(layout));
+    u32 result = (u32)(hash ^ (hash >> 32));
+    return result;
+}
+
 static void
 init_game_state(game_state *gs) {
     // NOTE: The entity index 0 is considerd null entity
@@ -55,6 +176,21 @@ next_free_entity_index(game_state *gs) {
     return index;
 }
 
+static tick_commands *
+push_tick_commands(memory_arena *arena) {
+    tick_commands *result = push_struct(arena, tick_commands);
+    result->spawned_entity_count = 0;
+    result->removed_entity_index_count = 0;
+    result->collision_event_count = 0;
+    return result;
+}
+
+static entity *
+get_entity(game_state *gs, u32 index) {
+    assert(index < count(gs->entities));
+    return gs->entities + index;
+}
+
 static int
 is_entity_set(entity *e, u32 flags) {
     return e->flags & flags;
@@ -65,11 +201,19 @@ set_entity(entity *e, u32 flags) {
     e->flags |= flags;
 }
 
+// NOTE: The returned entity is a pending spawn, it shows up in the entity
+// array after the next apply_entity_commands.
 static entity *
-add_entity(game_state *gs, entity_type type, vec2 pos) {
-    u32 index = next_free_entity_index(gs);
+add_entity(game_state *gs, tick_commands *commands, entity_type type, vec2 pos) {
+    assert(commands->spawned_entity_count < count(commands->spawned_entities));
+    assert(commands->spawned_entity_count < gs->free_entity_index_count);
 
-    entity *e = gs->entities + index;
+    // NOTE: Spawns are applied in order before any removal, popping the free
+    // list from the top, so the final index is already known here.
+    u32 index = gs->free_entity_indices[gs->free_entity_index_count - 1 -
+                                        commands->spawned_entity_count];
+
+    entity *e = commands->spawned_entities + commands->spawned_entity_count++;
     *e = (entity) {};
 
     e->index = index;
@@ -79,40 +223,84 @@ add_entity(game_state *gs, entity_type type, vec2 pos) {
 }
 
 static void
-remove_entity(game_state *gs, entity *e) {
-    assert(gs->free_entity_index_count < MAX_ENTITY_COUNT);
-    gs->free_entity_indices[gs->free_entity_index_count++] = e->index;
+remove_entity(tick_commands *commands, entity *e) {
+    assert(commands->removed_entity_index_count < count(commands->removed_entity_indices));
+    commands->removed_entity_indices[commands->removed_entity_index_count++] = e->index;
+}
+
+// NOTE: The sync point for structural changes. Spawns are applied before
+// removals, so an index freed in this tick is not reused before the next one.
+static void
+apply_entity_commands(game_state *gs, tick_commands *commands) {
+    for (u32 i = 0; i < commands->spawned_entity_count; ++i) {
+        entity *spawned = commands->spawned_entities + i;
+
+        u32 index = next_free_entity_index(gs);
+        assert(index == spawned->index);
+
+        gs->entities[index] = *spawned;
+    }
+    commands->spawned_entity_count = 0;
+
+    for (u32 i = 0; i < commands->removed_entity_index_count; ++i) {
+        entity *e = get_entity(gs, commands->removed_entity_indices[i]);
+
+        // NOTE: An entity can be removed more than once in a tick, e.g. a
+        // block hit by two balls
+        if (!is_entity_set(e, ENTITY_FLAG_REMOVED)) {
+            assert(gs->free_entity_index_count < MAX_ENTITY_COUNT);
+            gs->free_entity_indices[gs->free_entity_index_count++] = e->index;
 
-    set_entity(e, ENTITY_FLAG_REMOVED);
+            set_entity(e, ENTITY_FLAG_REMOVED);
+
+            // NOTE: Scored here so a block hit twice in a tick counts once
+            if (e->type == ENTITY_TYPE_BLOCK) {
+                gs->score += 1;
+            }
+        }
+    }
+    commands->removed_entity_index_count = 0;
+}
+
+static void
+push_collision_event(tick_commands *commands, u32 mover_index, u32 hit_index, vec2 normal) {
+    if (commands->collision_event_count < count(commands->collision_events)) {
+        collision_event *event = commands->collision_events + commands->collision_event_count++;
+        event->mover_index = mover_index;
+        event->hit_index = hit_index;
+        event->normal = normal;
+    } else {
+        logerr("Collision event queue is full\n");
+    }
 }
 
 static entity *
-add_block(game_state *gs, rect2 rect) {
-    entity *e = add_entity(gs, ENTITY_TYPE_BLOCK, getrect2cen(rect));
+add_block(game_state *gs, tick_commands *commands, rect2 rect) {
+    entity *e = add_entity(gs, commands, ENTITY_TYPE_BLOCK, getrect2cen(rect));
     e->size = getrect2size(rect);
     set_entity(e, ENTITY_FLAG_COLLIDE);
     return e;
 }
 
 static entity *
-add_wall(game_state *gs, rect2 rect) {
-    entity *e = add_entity(gs, ENTITY_TYPE_WALL, getrect2cen(rect));
+add_wall(game_state *gs, tick_commands *commands, rect2 rect) {
+    entity *e = add_entity(gs, commands, ENTITY_TYPE_WALL, getrect2cen(rect));
     e->size = getrect2size(rect);
     set_entity(e, ENTITY_FLAG_COLLIDE);
     return e;
 }
 
 static entity *
-add_paddle(game_state *gs, rect2 rect) {
-    entity *e = add_entity(gs, ENTITY_TYPE_PADDLE, getrect2cen(rect));
+add_paddle(game_state *gs, tick_commands *commands, rect2 rect) {
+    entity *e = add_entity(gs, commands, ENTITY_TYPE_PADDLE, getrect2cen(rect));
     e->size = getrect2size(rect);
     set_entity(e, ENTITY_FLAG_COLLIDE);
     return e;
 }
 
 static entity *
-add_ball(game_state *gs, rect2 rect, vec2 vel) {
-    entity *e = add_entity(gs, ENTITY_TYPE_BALL, getrect2cen(rect));
+add_ball(game_state *gs, tick_commands *commands, rect2 rect, vec2 vel) {
+    entity *e = add_entity(gs, commands, ENTITY_TYPE_BALL, getrect2cen(rect));
     e->size = getrect2size(rect);
     e->vel = vel;
     set_entity(e, ENTITY_FLAG_COLLIDE);
@@ -120,8 +308,8 @@ add_ball(game_state *gs, rect2 rect, vec2 vel) {
 }
 
 static entity *
-add_ball_tail(game_state *gs, entity *ball) {
-    entity *e = add_entity(gs, ENTITY_TYPE_BALL_TAIL, ball->pos);
+add_ball_tail(game_state *gs, tick_commands *commands, entity *ball) {
+    entity *e = add_entity(gs, commands, ENTITY_TYPE_BALL_TAIL, ball->pos);
     e->size = v2mul(0.6, ball->size);
     e->vel = v2zero();
     return e;
@@ -132,8 +320,73 @@ typedef struct {
     vec2 normal;
 } test_line;
 
+// NOTE: The bounds of all colliders, built once per update in the transient
+// arena. Every step of a mover is first tested against all of them at once,
+// only the colliders its swept bound overlaps go through the exact test.
+typedef struct {
+    u32 collider_count;
+    u32 *collider_entity_indices;
+    rect2 *collider_bounds;
+    // NOTE: Collider slot of every entity, ~0u if it does not collide
+    u32 *entity_collider_indices;
+
+    u8 *overlaps;
+    u32 *candidates;
+} broadphase;
+
 static void
-move_entity(game_state *gs, entity *mover, f32 dt) {
+init_broadphase(broadphase *bp, game_state *gs, memory_arena *arena) {
+    *bp = (broadphase) {};
+
+    bp->collider_entity_indices = push_array(arena, gs->entity_count, u32);
+    bp->collider_bounds = push_array(arena, gs->entity_count, rect2);
+    bp->entity_collider_indices = push_array(arena, gs->entity_count, u32);
+
+    for (u32 i = 0; i < gs->entity_count; ++i) {
+        entity *e = gs->entities + i;
+        bp->entity_collider_indices[i] = ~0u;
+
+        if (!is_entity_set(e, ENTITY_FLAG_REMOVED) && is_entity_set(e, ENTITY_FLAG_COLLIDE)) {
+            bp->entity_collider_indices[i] = bp->collider_count;
+            bp->collider_entity_indices[bp->collider_count] = i;
+            bp->collider_bounds[bp->collider_count] = rect2censize(e->pos, e->size);
+            bp->collider_count += 1;
+        }
+    }
+
+    bp->overlaps = push_array(arena, bp->collider_count, u8);
+    bp->candidates = push_array(arena, bp->collider_count, u32);
+}
+
+static void
+update_broadphase_bound(broadphase *bp, entity *e) {
+    u32 collider_index = bp->entity_collider_indices[e->index];
+    if (collider_index != ~0u) {
+        bp->collider_bounds[collider_index] = rect2censize(e->pos, e->size);
+    }
+}
+
+// NOTE: Fills candidates with the entity indices, in ascending order, of the
+// colliders that the mover can touch while moving by dp. The bound is padded
+// by a unit so rounding in the exact test never misses a grazing hit.
+static u32
+gather_broadphase_candidates(broadphase *bp, entity *mover, vec2 dp) {
+    vec2 reach = v2(fabsf(dp.x) + 0.5f * mover->size.x + 1.0f,
+                    fabsf(dp.y) + 0.5f * mover->size.y + 1.0f);
+    rect2 swept = rect2censize(mover->pos, v2mul(2.0f, reach));
+
+    test_rect2_overlap_n(bp->overlaps, swept, bp->collider_bounds, bp->collider_count);
+
+    u32 result = 0;
+    for (u32 i = 0; i < bp->collider_count; ++i) {
+        bp->candidates[result] = bp->collider_entity_indices[i];
+        result += bp->overlaps[i];
+    }
+    return result;
+}
+
+static void
+move_entity(game_state *gs, tick_commands *commands, broadphase *bp, entity *mover, f32 dt) {
     vec2 dp = v2mul(dt, mover->vel);
 
     for (int iteration = 0; getv2lensq(dp) > 0.0f && iteration < 4; ++iteration) {
@@ -143,7 +396,9 @@ move_entity(game_state *gs, entity *mover, f32 dt) {
         entity *hit_entity = 0;
         u32 hit_entity_index = 0;
 
-        for (u32 entity_index = 0; entity_index < gs->entity_count; ++entity_index) {
+        u32 candidate_count = gather_broadphase_candidates(bp, mover, dp);
+        for (u32 candidate_index = 0; candidate_index < candidate_count; ++candidate_index) {
+            u32 entity_index = bp->candidates[candidate_index];
             entity *test_entity = gs->entities + entity_index;
 
             if (mover == test_entity || is_entity_set(test_entity, ENTITY_FLAG_REMOVED) ||
@@ -201,15 +456,15 @@ move_entity(game_state *gs, entity *mover, f32 dt) {
                 v2mul(2.0f, v2mul(v2dot(mover->vel, normal), normal))
             );
 
-            if (hit_entity->type == ENTITY_TYPE_BLOCK) {
-                remove_entity(gs, hit_entity);
-            }
+            push_collision_event(commands, mover->index, hit_entity_index, normal);
         }
     }
+
+    update_broadphase_bound(bp, mover);
 }
 
 static void
-init(game_state *gs) {
+init(game_state *gs, tick_commands *commands) {
     // Build blocks
     {
         vec2 margin = v2(100.0f, 300.0f);
@@ -218,7 +473,7 @@ init(game_state *gs) {
         f32 padding = 10.0f;
         for (int y = 0; y < 8; ++y) {
             for (int x = 0; x < 10; ++x) {
-                add_block(gs, rect2minsize(min, size));
+                add_block(gs, commands, rect2minsize(min, size));
                 min.x += size.x + padding;
             }
             min.x = margin.x;
@@ -229,35 +484,71 @@ init(game_state *gs) {
     // Build walls
     {
         // left
-        add_wall(gs, rect2minsize(v2(0.0f, 0.0f), v2(15.0f, 600.0f)));
+        add_wall(gs, commands, rect2minsize(v2(0.0f, 0.0f), v2(15.0f, 600.0f)));
         // top
-        add_wall(gs, rect2minsize(v2(0.0f, 600.0f - 15.0f), v2(800.0f, 15.0f)));
+        add_wall(gs, commands, rect2minsize(v2(0.0f, 600.0f - 15.0f), v2(800.0f, 15.0f)));
         // right
-        add_wall(gs, rect2minsize(v2(800.0f - 15.0f, 0.0f), v2(15.0f, 600.0f)));
+        add_wall(gs, commands, rect2minsize(v2(800.0f - 15.0f, 0.0f), v2(15.0f, 600.0f)));
         // down
-        add_wall(gs, rect2minsize(v2(0.0f, -15.0f), v2(800.0f, 15.0f)));
+        add_wall(gs, commands, rect2minsize(v2(0.0f, -15.0f), v2(800.0f, 15.0f)));
     }
 
-    gs->player_paddle = add_paddle(
-        gs, rect2censize(v2(400.0f, 35.0f), v2(100.0f, 30.0f))
-    );
+    gs->player_paddle_index = add_paddle(
+        gs, commands, rect2censize(v2(400.0f, 35.0f), v2(100.0f, 30.0f))
+    )->index;
+
+    add_ball(gs, commands, rect2censize(v2(400.0f, 150.0f), v2(15.0f, 15.0f)), v2(200.0f, 200.0f));
+
+    gs->lives = START_LIVES;
 
-    add_ball(gs, rect2censize(v2(400.0f, 150.0f), v2(15.0f, 15.0f)), v2(200.0f, 200.0f));
+    apply_entity_commands(gs, commands);
+}
+
+// NOTE: Out of lives or out of blocks. The entity index 0 is the null entity.
+static int
+is_game_over(game_state *gs) {
+    if (gs->lives == 0) {
+        return 1;
+    }
+
+    for (u32 i = 1; i < gs->entity_count; ++i) {
+        entity *e = gs->entities + i;
+        if (e->type == ENTITY_TYPE_BLOCK && !is_entity_set(e, ENTITY_FLAG_REMOVED)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void
+handle_input(game_state *gs, frame_input *input) {
+    if (input->flags & INPUT_FLAG_MOVE_PADDLE) {
+        get_entity(gs, gs->player_paddle_index)->pos.x = input->paddle_x;
+    }
 }
 
 static void
-handle_event(game_state *gs, SDL_Event *e) {
-    switch (e->type) {
-        case SDL_MOUSEMOTION: {
-            gs->player_paddle->pos.x = e->motion.x;
-        } break;
-        default: break;
+handle_collision_events(game_state *gs, tick_commands *commands) {
+    for (u32 i = 0; i < commands->collision_event_count; ++i) {
+        collision_event *event = commands->collision_events + i;
+        entity *hit = get_entity(gs, event->hit_index);
+
+        if (hit->type == ENTITY_TYPE_BLOCK) {
+            remove_entity(commands, hit);
+        }
+
+        // NOTE: The bottom wall is the only one below the screen
+        if (hit->type == ENTITY_TYPE_WALL && hit->pos.y < 0.0f && gs->lives > 0) {
+            gs->lives -= 1;
+        }
     }
 }
 
 static void
-update_and_render(game_state *gs, render_context *ctx, f32 dt) {
-    memset(ctx->buf, 0, sizeof(*ctx->buf) * ctx->width * ctx->height);
+update_game(game_state *gs, tick_commands *commands, memory_arena *transient, f32 dt) {
+    broadphase bp;
+    init_broadphase(&bp, gs, transient);
 
     for (u32 i = 0; i < gs->entity_count; ++i) {
         entity *e = gs->entities + i;
@@ -268,28 +559,261 @@ update_and_render(game_state *gs, render_context *ctx, f32 dt) {
 
         switch (e->type) {
             case ENTITY_TYPE_BALL: {
-                add_ball_tail(gs, e);
-                move_entity(gs, e, dt);
+                add_ball_tail(gs, commands, e);
+                move_entity(gs, commands, &bp, e, dt);
             } break;
 
             case ENTITY_TYPE_BALL_TAIL: {
                 e->size = v2sub(e->size, v2(0.05f, 0.05f));
                 if (getv2lensq(e->size) < 16.0f) {
-                    remove_entity(gs, e);
+                    remove_entity(commands, e);
                 }
             } break;
 
             default: break;
         }
+    }
+
+    handle_collision_events(gs, commands);
+
+    apply_entity_commands(gs, commands);
+}
+
+static void
+play_collision_sounds(game_state *gs, tick_commands *commands, audio_state *audio) {
+    for (u32 i = 0; i < commands->collision_event_count; ++i) {
+        collision_event *event = commands->collision_events + i;
+        entity *hit = get_entity(gs, event->hit_index);
+
+        switch (hit->type) {
+            case ENTITY_TYPE_BLOCK: {
+                play_sound(audio, SOUND_BLOCK_HIT, 0.6f);
+            } break;
+
+            case ENTITY_TYPE_PADDLE: {
+                play_sound(audio, SOUND_PADDLE_HIT, 0.6f);
+            } break;
+
+            case ENTITY_TYPE_WALL: {
+                play_sound(audio, SOUND_WALL_HIT, 0.4f);
+            } break;
 
-        render_rect(ctx, rect2censize(e->pos, e->size), rgba(1.0f, 1.0f, 1.0f, 1.0f));
+            default: break;
+        }
     }
 }
 
+// NOTE: Assets are not part of game_state, they are loaded once at startup
+// and never snapshotted.
+typedef struct {
+    sprite_atlas atlas;
+    sprite entity_sprites[ENTITY_TYPE_COUNT];
+} game_assets;
+
+static void
+load_assets(game_assets *assets, memory_arena *arena) {
+    *assets = (game_assets) {};
+
+    init_sprite_atlas(&assets->atlas, arena);
+
+    struct {
+        entity_type type;
+        const char *path;
+    } sprite_paths[] = {
+        { ENTITY_TYPE_BLOCK, DATA_PATH "block.bmp" },
+        { ENTITY_TYPE_PADDLE, DATA_PATH "paddle.bmp" },
+        { ENTITY_TYPE_BALL, DATA_PATH "ball.bmp" },
+    };
+
+    for (u32 i = 0; i < count(sprite_paths); ++i) {
+        // NOTE: Entities without a sprite are drawn as rects
+        load_sprite(&assets->atlas, sprite_paths[i].path,
+                    assets->entity_sprites + sprite_paths[i].type);
+    }
+}
+
+static void
+render_game(game_state *gs, game_assets *assets, render_context *ctx) {
+    shade background = shade_vertical(rgba(0.0f, 0.0f, 0.0f, 1.0f),
+                                      rgba(0.02f, 0.02f, 0.06f, 1.0f),
+                                      SHADE_FLAG_GAMMA_CORRECT);
+    render_shaded_rect(ctx, rect2minsize(v2zero(), v2(WORLD_WIDTH, WORLD_HEIGHT)), background);
+
+    for (u32 i = 0; i < gs->entity_count; ++i) {
+        entity *e = gs->entities + i;
+
+        if (is_entity_set(e, ENTITY_FLAG_REMOVED)) {
+            continue;
+        }
+
+        rect2 rect = rect2censize(e->pos, e->size);
+
+        sprite *s = assets->entity_sprites + e->type;
+        if (is_sprite_loaded(s)) {
+            render_sprite(ctx, &assets->atlas, s, rect);
+            continue;
+        }
+
+        vec4 color = rgba(1.0f, 1.0f, 1.0f, 1.0f);
+        if (e->type == ENTITY_TYPE_BALL_TAIL) {
+            // NOTE: Tails fade out while they shrink
+            color.a = 0.1f * e->size.x;
+        }
+
+        render_rect(ctx, rect, color);
+    }
+}
+
+typedef struct {
+    font large_font;
+    font small_font;
+
+    text_layout score;
+    text_layout lives;
+    text_layout counters[PROFILE_COUNTER_COUNT];
+
+    u32 shown_score;
+    u32 shown_lives;
+    u32 shown_report_index;
+
+    i32 is_visible;
+} hud;
+
+static void
+init_hud(hud *h, memory_arena *arena) {
+    *h = (hud) {};
+
+    // NOTE: Opaque glyphs on a transparent background, both premultiplied as
+    // they are, so the HUD does not hide the top row of blocks
+    vec4 foreground = rgba(0.9f, 0.9f, 0.9f, 1.0f);
+    vec4 background = rgba(0.0f, 0.0f, 0.0f, 0.0f);
+    init_font(&h->large_font, arena, 2, foreground, background);
+    init_font(&h->small_font, arena, 1, foreground, background);
+
+    init_text_layout(&h->score, arena, &h->large_font);
+    init_text_layout(&h->lives, arena, &h->large_font);
+    for (u32 i = 0; i < count(h->counters); ++i) {
+        init_text_layout(h->counters + i, arena, &h->small_font);
+    }
+
+    // NOTE: Force the first layout
+    h->shown_score = ~0u;
+    h->shown_lives = ~0u;
+    h->shown_report_index = ~0u;
+
+    h->is_visible = 1;
+}
+
+// NOTE: Texts are only formatted and laid out again when the value behind
+// them changes, otherwise drawing the HUD is a blend per row of every line.
+static void
+render_hud(hud *h, game_state *gs, render_context *ctx) {
+    char text[TEXT_MAX_LENGTH + 1];
+
+    if (h->shown_score != gs->score) {
+        snprintf(text, sizeof(text), "score %u", gs->score);
+        set_text(&h->score, &h->large_font, text);
+        h->shown_score = gs->score;
+    }
+
+    if (h->shown_lives != gs->lives) {
+        snprintf(text, sizeof(text), "lives %u", gs->lives);
+        set_text(&h->lives, &h->large_font, text);
+        h->shown_lives = gs->lives;
+    }
+
+    if (h->shown_report_index != profile_report_index) {
+        for (u32 id = 0; id < PROFILE_COUNTER_COUNT; ++id) {
+            profile_counter *counter = profile_counters + id;
+            snprintf(text, sizeof(text), "%-8s %8.2fus max %8.2fus",
+                     counter->name, counter->last_avg_us, counter->last_max_us);
+            set_text(h->counters + id, &h->small_font, text);
+        }
+        h->shown_report_index = profile_report_index;
+    }
+
+    vec2 pos = v2(20.0f, ctx->height - 20.0f);
+
+    pos.y -= h->score.height;
+    render_text(ctx, &h->score, pos);
+    pos.y -= h->lives.height;
+    render_text(ctx, &h->lives, pos);
+
+    for (u32 id = 0; id < PROFILE_COUNTER_COUNT; ++id) {
+        text_layout *layout = h->counters + id;
+        pos.y -= layout->height;
+        render_text(ctx, layout, pos);
+    }
+}
+
+// NOTE: tests.c includes the whole game without its entry point
+#ifndef BREAKOUT_NO_MAIN
+
+// NOTE: Without arguments the game is played normally.
+//
+//   --record <file>   play and capture every frame with its input to file
+//   --replay <file>   replay the input of a capture and compare every frame
+//                     against it, exits with 1 if any frame differs
+//   --diff <a> <b>    compare two captures without running the game
+//   --new             start a new game instead of resuming the checkpoint
+//   --stats           log the profile, audio and memory reports every second
+//   --render-scale <f>
+//                     render at a fraction f of the full internal resolution,
+//                     0 < f <= 1, dynamic resolution scales down from there
+//
+// --record and --replay can be combined to capture a new golden file while
+// checking against the old one.
 int
-main(void) {
+main(int argc, char **argv) {
     SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
 
+    // NOTE: Everything below allocates from here, the frame loop never calls
+    // into the heap
+    game_memory memory;
+    if (!init_game_memory(&memory, PERMANENT_MEMORY_SIZE, TRANSIENT_MEMORY_SIZE)) {
+        return 1;
+    }
+
+    const char *record_path = 0;
+    const char *replay_path = 0;
+    int is_new_game = 0;
+    int is_logging_stats = 0;
+    f32 render_scale = 1.0f;
+
+    for (i32 i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--diff") == 0 && i + 2 < argc) {
+            return diff_captures(&memory.permanent, argv[i + 1], argv[i + 2]) == 0 ? 0 : 1;
+        } else if (strcmp(argv[i], "--new") == 0) {
+            is_new_game = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            is_logging_stats = 1;
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            char *end;
+            render_scale = strtof(argv[++i], &end);
+            if (*end || !(render_scale > 0.0f && render_scale <= 1.0f)) {
+                logerr("The render scale must be greater than 0 and at most 1\n");
+                return 1;
+            }
+        } else {
+            logerr("Usage: %s [--record <file>] [--replay <file>] [--diff <file> <golden file>] "
+                   "[--new] [--stats] [--render-scale <fraction>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // NOTE: Frames only repeat when the game starts from scratch at a fixed
+    // resolution
+    i32 is_capturing = record_path || replay_path;
+
+    input_recording replay = {};
+    if (replay_path && !load_input_recording(&replay, &memory.permanent, replay_path)) {
+        return 1;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         logerr("Failed to initialize SDL: %s\n", SDL_GetError());
         return 1;
@@ -324,20 +848,73 @@ main(void) {
                                              SDL_TEXTUREACCESS_STREAMING,
                                              window_w, window_h);
 
-    u32 *buffer = calloc(window_w * window_h, sizeof(u32));
-
     render_context ctx;
-    ctx.renderer = renderer;
-    ctx.texture = texture;
-    ctx.buf = buffer;
-    ctx.width = window_w;
-    ctx.height = window_h;
-    ctx.pitch = ctx.width * 4;
+    init_render_context(&ctx, &memory.permanent, renderer, texture, window_w, window_h, RENDER_WIDTH, RENDER_HEIGHT);
+    i32 render_width = scale_resolution(RENDER_WIDTH, render_scale);
+    i32 render_height = scale_resolution(RENDER_HEIGHT, render_scale);
+    set_render_resolution(&ctx, render_width, render_height, render_width / WORLD_WIDTH);
+
+    // NOTE: F2 switches the upscale filter, F3 turns dynamic resolution
+    // scaling on and off
+    dynamic_resolution dr;
+    init_dynamic_resolution(&dr, &ctx, FRAME_BUDGET_US);
+    if (is_capturing) {
+        dr.is_enabled = 0;
+    }
+
+    capture_state *capture = push_struct(&memory.permanent, capture_state);
+    if (is_capturing &&
+        !init_capture(capture, &memory.permanent, ctx.output_width, ctx.output_height, record_path, replay_path))
+    {
+        return 1;
+    }
+
+    game_assets *assets = push_struct(&memory.permanent, game_assets);
+    load_assets(assets, &memory.permanent);
+
+    hud *game_hud = push_struct(&memory.permanent, hud);
+    init_hud(game_hud, &memory.permanent);
+
+    audio_state *audio = push_struct(&memory.permanent, audio_state);
+    init_audio(audio, &memory.permanent);
+
+    game_state *gs = push_struct(&memory.permanent, game_state);
+
+    // NOTE: The checkpoint is still written when it is not resumed from
+    checkpoint_file checkpoint = { .fd = -1 };
+    game_state *saved = 0;
+    if (!is_capturing &&
+        open_checkpoint(&checkpoint, CHECKPOINT_PATH, sizeof(game_state),
+                        get_game_state_layout_hash()))
+    {
+        saved = get_checkpoint_state(&checkpoint);
+        if (is_game_over(saved)) {
+            SDL_Log("The game in %s is over, starting a new one\n", CHECKPOINT_PATH);
+            saved = 0;
+        }
+    }
+
+    if (saved && !is_new_game) {
+        SDL_Log("Resuming from %s\n", CHECKPOINT_PATH);
+        restore_game_state(gs, saved);
+    } else {
+        init_game_state(gs);
+        init(gs, push_tick_commands(&memory.transient));
+    }
 
-    game_state gs = {};
-    init_game_state(&gs);
+    // NOTE: F5 saves a snapshot of the game, F9 restores it
+    game_state *quicksave = push_struct(&memory.permanent, game_state);
+    save_game_state(gs, quicksave);
 
-    init(&gs);
+    // NOTE: Holding backspace walks the game back in time
+    rewind_buffer *rewind = push_struct(&memory.permanent, rewind_buffer);
+    init_rewind_buffer(rewind, &memory.permanent, REWIND_BUFFER_SIZE, sizeof(game_state));
+    reset_rewind_buffer(rewind, gs);
+
+    report_memory_usage(&memory);
+    i32 is_rewinding = 0;
+
+    u32 frame_index = 0;
 
     f32 dt = 1.0f / 60.0f;
     //u32 target_frametime = dt * 1000.0f;
@@ -346,6 +923,8 @@ main(void) {
     while (!quit) {
         //u32 frame_begin = SDL_GetTicks();
 
+        frame_input input = {};
+
         SDL_Event e;
         while (SDL_PollEvent(&e)) {
             switch (e.type) {
@@ -354,24 +933,155 @@ main(void) {
                 } break;
 
                 case SDL_KEYDOWN: {
-                    if (e.key.keysym.sym == SDLK_ESCAPE) {
-                        quit = 1;
+                    switch (e.key.keysym.sym) {
+                        case SDLK_ESCAPE: {
+                            quit = 1;
+                        } break;
+
+                        case SDLK_BACKSPACE: {
+                            is_rewinding = 1;
+                        } break;
+
+                        case SDLK_F1: {
+                            game_hud->is_visible = !game_hud->is_visible;
+                        } break;
+
+                        case SDLK_F2: {
+                            input.flags |= INPUT_FLAG_NEXT_FILTER;
+                        } break;
+
+                        case SDLK_F3: {
+                            if (!is_capturing) {
+                                dr.is_enabled = !dr.is_enabled;
+                                if (!dr.is_enabled) {
+                                    set_dynamic_resolution_level(&dr, &ctx, 0);
+                                }
+                            }
+                        } break;
+
+                        case SDLK_F5: {
+                            input.flags |= INPUT_FLAG_QUICKSAVE;
+                        } break;
+
+                        case SDLK_F9: {
+                            input.flags |= INPUT_FLAG_QUICKLOAD;
+                        } break;
+
+                        default: break;
                     }
                 } break;
 
+                case SDL_KEYUP: {
+                    if (e.key.keysym.sym == SDLK_BACKSPACE) {
+                        is_rewinding = 0;
+                    }
+                } break;
+
+                case SDL_MOUSEMOTION: {
+                    input.flags |= INPUT_FLAG_MOVE_PADDLE;
+                    input.paddle_x = e.motion.x * WORLD_WIDTH / window_w;
+                } break;
+
                 default: break;
             }
+        }
 
-            handle_event(&gs, &e);
+        if (is_rewinding) {
+            input.flags |= INPUT_FLAG_REWIND;
         }
 
-        update_and_render(&gs, &ctx, dt);
+        if (replay_path) {
+            if (frame_index == replay.frame_count) {
+                break;
+            }
+            input = replay.inputs[frame_index];
+        }
+
+        BEGIN_PROFILE(FRAME);
+
+        reset_arena(&memory.transient);
+
+        if (input.flags & INPUT_FLAG_NEXT_FILTER) {
+            ctx.filter = (ctx.filter + 1) % UPSCALE_FILTER_COUNT;
+        }
+
+        if (input.flags & INPUT_FLAG_QUICKSAVE) {
+            save_game_state(gs, quicksave);
+        }
+
+        if (input.flags & INPUT_FLAG_QUICKLOAD) {
+            restore_game_state(gs, quicksave);
+            reset_rewind_buffer(rewind, gs);
+        }
+
+        if (input.flags & INPUT_FLAG_REWIND) {
+            BEGIN_PROFILE(REWIND);
+            pop_rewind_state(rewind, gs);
+            END_PROFILE(REWIND);
+        } else {
+            handle_input(gs, &input);
+            tick_commands *commands = push_tick_commands(&memory.transient);
+            update_game(gs, commands, &memory.transient, dt);
+            play_collision_sounds(gs, commands, audio);
+
+            BEGIN_PROFILE(SNAPSHOT);
+            state_range ranges[MAX_STATE_RANGE_COUNT];
+            u32 range_count = get_game_state_ranges(gs, ranges);
+            push_rewind_state(rewind, gs, ranges, range_count);
+            save_checkpoint(&checkpoint, gs, ranges, range_count);
+            END_PROFILE(SNAPSHOT);
+        }
+
+        render_game(gs, assets, &ctx);
+
+        BEGIN_PROFILE(UPSCALE);
+        upscale_frame(&ctx);
+        END_PROFILE(UPSCALE);
+
+        // NOTE: Captured before the HUD, whose timings differ between runs
+        if (is_capturing) {
+            BEGIN_PROFILE(CAPTURE);
+            push_capture_frame(capture, ctx.present_buf, frame_index, input);
+            END_PROFILE(CAPTURE);
+        }
+
+        // NOTE: The HUD goes on top of the upscaled image so it stays sharp
+        if (game_hud->is_visible) {
+            BEGIN_PROFILE(HUD);
+            render_context output = get_output_context(&ctx);
+            render_hud(game_hud, gs, &output);
+            END_PROFILE(HUD);
+        }
+
+        u64 frame_ticks = END_PROFILE(FRAME);
+
+        // NOTE: The counters start a new period either way, the HUD shows them
+        if (++frame_index % 60 == 0) {
+            report_profile_counters(is_logging_stats);
+            if (is_logging_stats) {
+                report_audio_stats(audio);
+                report_memory_usage(&memory);
+            }
+        }
 
         //u32 frametime = SDL_GetTicks() - frame_begin;
         //printf("%u\n", frametime);
 
         render_to_screen(&ctx);
 
+        update_dynamic_resolution(&dr, &ctx, ticks_to_us(frame_ticks));
+
+        // NOTE: Like a frame cap, this waits between frames and never while
+        // one is being rendered. Without it a fast replay outruns the writer
+        // and frames go unchecked. A live recording is played by a person, so
+        // it never waits, a frame whose pixels find no free buffer is
+        // recorded without them.
+        if (replay_path) {
+            while (!has_free_capture_buffer(capture)) {
+                SDL_Delay(1);
+            }
+        }
+
 #if 0
         frametime = SDL_GetTicks() - frame_begin;
         if (target_frametime > frametime) {
@@ -380,9 +1090,26 @@ main(void) {
 #endif
     }
 
+    int result = 0;
+    if (is_capturing && !close_capture(capture) && replay_path) {
+        result = 1;
+    }
+
+    // NOTE: A replay that was quit early never compared the rest of its frames
+    if (replay_path && frame_index < replay.frame_count) {
+        logerr("Replay stopped after %u of %u frames\n", frame_index, replay.frame_count);
+        result = 1;
+    }
+
+    close_audio(audio);
+    close_checkpoint(&checkpoint);
+
     SDL_DestroyTexture(texture);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    return 0;
+    close_game_memory(&memory);
+
+    return result;
 }
+#endif
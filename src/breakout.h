@@ -1,18 +1,37 @@
 #ifndef BREAKOUT_H
 #define BREAKOUT_H
 
+// NOTE: Exposes the POSIX calls used for memory mapping under -std=c11
+#define _DEFAULT_SOURCE
+
 #include <SDL2/SDL.h>
 #undef main
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #define logerr(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 
 #define count(a) (sizeof(a) / sizeof(*(a)))
 
 #include "types.h"
+#include "arena.h"
 #include "math.h"
 #include "renderer.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "sprite.h"
+#include "text.h"
+#include "audio.h"
+#include "capture.h"
 
 #endif
@@ -0,0 +1,592 @@
+// NOTE: FNV-1a on whole pixels instead of bytes, the hash only has to tell
+// frames apart
+static u64
+hash_pixels(u32 *pixels, u32 count) {
+    u64 result = 14695981039346656037ull;
+    for (u32 i = 0; i < count; ++i) {
+        result ^= pixels[i];
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+// NOTE: Returns the encoded size, or 0 if the encoding would not be smaller
+// than capacity. Runs shorter than three pixels stay literal, a run costs as
+// much as two literal pixels.
+static u32
+encode_capture_rle(u8 *out, u32 capacity, u32 *pixels, u32 count) {
+    u8 *at = out;
+    u8 *end = out + capacity;
+
+    u32 i = 0;
+    while (i < count) {
+        u32 run = 1;
+        while (i + run < count && pixels[i + run] == pixels[i]) {
+            ++run;
+        }
+
+        if (run >= 3) {
+            if (end - at < 8) {
+                return 0;
+            }
+
+            u32 header = CAPTURE_RLE_RUN_BIT | run;
+            memcpy(at, &header, sizeof(u32));
+            memcpy(at + 4, pixels + i, sizeof(u32));
+            at += 8;
+            i += run;
+            continue;
+        }
+
+        u32 literal_begin = i;
+        while (i < count &&
+               !(i + 2 < count && pixels[i] == pixels[i + 1] && pixels[i] == pixels[i + 2]))
+        {
+            ++i;
+        }
+
+        u32 literal_count = i - literal_begin;
+        if ((u32)(end - at) < 4 + literal_count * sizeof(u32)) {
+            return 0;
+        }
+
+        memcpy(at, &literal_count, sizeof(u32));
+        memcpy(at + 4, pixels + literal_begin, literal_count * sizeof(u32));
+        at += 4 + literal_count * sizeof(u32);
+    }
+
+    // NOTE: Filling the buffer exactly is not smaller either
+    u32 result = at < end ? at - out : 0;
+    return result;
+}
+
+// NOTE: Checks every header against both buffers, golden files come from
+// disk. Returns 0 if the data does not decode to exactly count pixels.
+static int
+decode_capture_rle(u32 *pixels, u32 count, u8 *data, u32 size) {
+    u8 *at = data;
+    u8 *end = data + size;
+    u32 i = 0;
+
+    while (end - at >= 4) {
+        u32 header;
+        memcpy(&header, at, sizeof(u32));
+        at += 4;
+
+        if (header & CAPTURE_RLE_RUN_BIT) {
+            u32 run = header & ~CAPTURE_RLE_RUN_BIT;
+            if (end - at < 4 || run > count - i) {
+                return 0;
+            }
+
+            u32 pixel;
+            memcpy(&pixel, at, sizeof(u32));
+            at += 4;
+            fill_span(pixels + i, run, pixel);
+            i += run;
+        } else {
+            if ((u32)(end - at) / sizeof(u32) < header || header > count - i) {
+                return 0;
+            }
+
+            memcpy(pixels + i, at, header * sizeof(u32));
+            at += header * sizeof(u32);
+            i += header;
+        }
+    }
+
+    return at == end && i == count;
+}
+
+static int
+read_capture_header(FILE *file, const char *path, i32 width, i32 height) {
+    capture_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != CAPTURE_MAGIC ||
+        header.version != CAPTURE_VERSION)
+    {
+        logerr("%s is not a capture\n", path);
+        return 0;
+    }
+
+    if (width && (header.width != width || header.height != height)) {
+        logerr("%s is %dx%d, expected %dx%d\n", path,
+               header.width, header.height, width, height);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+skip_capture_pixels(FILE *file, capture_frame_header *header) {
+    int result = fseek(file, header->size, SEEK_CUR) == 0;
+    return result;
+}
+
+// NOTE: scratch must hold count pixels, an RLE frame is never larger than
+// the raw one
+static int
+read_capture_pixels(FILE *file, capture_frame_header *header,
+                    u32 *pixels, u8 *scratch, u32 count)
+{
+    if (header->encoding == CAPTURE_ENCODING_RAW) {
+        return header->size == count * sizeof(u32) &&
+               fread(pixels, header->size, 1, file) == 1;
+    }
+
+    if (header->encoding == CAPTURE_ENCODING_RLE) {
+        return header->size <= count * sizeof(u32) &&
+               fread(scratch, header->size, 1, file) == 1 &&
+               decode_capture_rle(pixels, count, scratch, header->size);
+    }
+
+    return 0;
+}
+
+// NOTE: Logs where two frames differ. Positions are in framebuffer
+// coordinates, y counts up from the bottom row.
+static void
+report_frame_difference(u32 frame_index, u32 *pixels, u32 *golden, i32 width, i32 height) {
+    u32 diff_count = 0;
+    i32 first_x = 0;
+    i32 first_y = 0;
+    u32 max_delta = 0;
+
+    for (i32 row = 0; row < height; ++row) {
+        for (i32 x = 0; x < width; ++x) {
+            u32 a = pixels[row * width + x];
+            u32 b = golden[row * width + x];
+            if (a == b) {
+                continue;
+            }
+
+            if (diff_count == 0) {
+                first_x = x;
+                first_y = height - 1 - row;
+            }
+            diff_count += 1;
+
+            for (u32 shift = 0; shift < 32; shift += 8) {
+                i32 delta = (i32)((a >> shift) & 0xFF) - (i32)((b >> shift) & 0xFF);
+                u32 abs_delta = delta < 0 ? -delta : delta;
+                if (abs_delta > max_delta) {
+                    max_delta = abs_delta;
+                }
+            }
+        }
+    }
+
+    logerr("Frame %u differs in %u pixels, first at (%d, %d), max channel delta %u\n",
+           frame_index, diff_count, first_x, first_y, max_delta);
+}
+
+static void
+write_capture_frame(capture_state *cs, capture_entry *entry, u32 *pixels, u64 hash) {
+    u32 pixel_count = cs->width * cs->height;
+
+    capture_frame_header header = {};
+    header.hash = hash;
+    header.frame_index = entry->frame_index;
+    header.input = entry->input;
+
+    u8 *data = 0;
+    if (pixels) {
+        u32 encoded_size = encode_capture_rle(cs->encoded, pixel_count * sizeof(u32),
+                                              pixels, pixel_count);
+        if (encoded_size) {
+            header.encoding = CAPTURE_ENCODING_RLE;
+            header.size = encoded_size;
+            data = cs->encoded;
+        } else {
+            header.encoding = CAPTURE_ENCODING_RAW;
+            header.size = pixel_count * sizeof(u32);
+            data = (u8 *)pixels;
+        }
+    }
+
+    if (fwrite(&header, sizeof(header), 1, cs->out) != 1 ||
+        (header.size && fwrite(data, header.size, 1, cs->out) != 1))
+    {
+        logerr("Failed to write capture frame %u\n", entry->frame_index);
+        return;
+    }
+
+    cs->written_frame_count += 1;
+}
+
+// NOTE: The golden file is read front to back, frames missing on either side
+// are skipped. The pixels are only read when the hashes differ.
+static void
+compare_capture_frame(capture_state *cs, u32 frame_index, u32 *pixels, u64 hash) {
+    u32 pixel_count = cs->width * cs->height;
+    capture_frame_header *golden = &cs->golden_header;
+
+    for (;;) {
+        if (!cs->has_golden_header) {
+            if (fread(golden, sizeof(*golden), 1, cs->golden) != 1) {
+                cs->missing_golden_frame_count += 1;
+                return;
+            }
+            cs->has_golden_header = 1;
+        }
+
+        if (golden->frame_index >= frame_index) {
+            break;
+        }
+
+        skip_capture_pixels(cs->golden, golden);
+        cs->has_golden_header = 0;
+    }
+
+    if (golden->frame_index > frame_index) {
+        cs->missing_golden_frame_count += 1;
+        return;
+    }
+
+    cs->has_golden_header = 0;
+
+    if (golden->encoding == CAPTURE_ENCODING_NONE) {
+        cs->missing_golden_frame_count += 1;
+        return;
+    }
+
+    cs->compared_frame_count += 1;
+
+    if (golden->hash == hash) {
+        skip_capture_pixels(cs->golden, golden);
+        return;
+    }
+
+    cs->mismatched_frame_count += 1;
+
+    if (read_capture_pixels(cs->golden, golden, cs->golden_pixels, cs->encoded, pixel_count)) {
+        report_frame_difference(frame_index, pixels, cs->golden_pixels, cs->width, cs->height);
+    } else {
+        logerr("Failed to read golden frame %u\n", frame_index);
+    }
+}
+
+static int
+capture_writer_thread(void *data) {
+    capture_state *cs = (capture_state *)data;
+    u32 pixel_count = cs->width * cs->height;
+
+    for (;;) {
+        SDL_SemWait(cs->queue_semaphore);
+
+        u32 read_index = atomic_load_explicit(&cs->queue_read_index, memory_order_relaxed);
+        u32 write_index = atomic_load_explicit(&cs->queue_write_index, memory_order_acquire);
+
+        if (read_index == write_index) {
+            // NOTE: Every queued frame has its own post, so the queue is
+            // drained by the time the stop post comes around
+            if (atomic_load_explicit(&cs->is_stopping, memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+
+        capture_entry entry = cs->queue[read_index & (CAPTURE_QUEUE_SIZE - 1)];
+        atomic_store_explicit(&cs->queue_read_index, read_index + 1, memory_order_release);
+
+        u32 *pixels = 0;
+        u64 hash = 0;
+        if (entry.pool_index != CAPTURE_NO_PIXELS) {
+            pixels = cs->pool[entry.pool_index];
+            hash = hash_pixels(pixels, pixel_count);
+        }
+
+        if (cs->out) {
+            write_capture_frame(cs, &entry, pixels, hash);
+        }
+
+        if (pixels) {
+            if (cs->golden) {
+                compare_capture_frame(cs, entry.frame_index, pixels, hash);
+            }
+
+            u32 free_write_index = atomic_load_explicit(&cs->free_write_index, memory_order_relaxed);
+            cs->free_ring[free_write_index & (CAPTURE_POOL_SIZE - 1)] = entry.pool_index;
+            atomic_store_explicit(&cs->free_write_index, free_write_index + 1, memory_order_release);
+        }
+    }
+
+    return 0;
+}
+
+// NOTE: Writes every frame to out_path and compares every frame against
+// golden_path, either can be 0. All memory the capture needs is allocated
+// here.
+static int
+init_capture(capture_state *cs, memory_arena *arena, i32 width, i32 height,
+             const char *out_path, const char *golden_path)
+{
+    *cs = (capture_state) {};
+
+    cs->width = width;
+    cs->height = height;
+    u32 frame_size = width * height * sizeof(u32);
+
+    if (out_path) {
+        cs->out = fopen(out_path, "wb");
+        if (!cs->out) {
+            logerr("Failed to open %s\n", out_path);
+            return 0;
+        }
+
+        capture_header header = { CAPTURE_MAGIC, CAPTURE_VERSION, width, height };
+        fwrite(&header, sizeof(header), 1, cs->out);
+    }
+
+    if (golden_path) {
+        cs->golden = fopen(golden_path, "rb");
+        if (!cs->golden) {
+            logerr("Failed to open %s\n", golden_path);
+            return 0;
+        }
+
+        if (!read_capture_header(cs->golden, golden_path, width, height)) {
+            return 0;
+        }
+    }
+
+    for (u32 i = 0; i < CAPTURE_POOL_SIZE; ++i) {
+        cs->pool[i] = (u32 *)push_buffer(arena, frame_size);
+        cs->free_ring[i] = i;
+    }
+    atomic_store_explicit(&cs->free_write_index, CAPTURE_POOL_SIZE, memory_order_release);
+
+    cs->encoded = push_buffer(arena, frame_size);
+    cs->golden_pixels = (u32 *)push_buffer(arena, frame_size);
+
+    cs->queue_semaphore = SDL_CreateSemaphore(0);
+    cs->thread = SDL_CreateThread(capture_writer_thread, "capture", cs);
+    if (!cs->queue_semaphore || !cs->thread) {
+        logerr("Failed to start the capture thread: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    return 1;
+}
+
+static int
+has_free_capture_buffer(capture_state *cs) {
+    u32 free_read_index = atomic_load_explicit(&cs->free_read_index, memory_order_relaxed);
+    u32 free_write_index = atomic_load_explicit(&cs->free_write_index, memory_order_acquire);
+    return free_read_index != free_write_index;
+}
+
+// NOTE: Called from the game thread only, once per frame. Never blocks or
+// allocates, the cost is one copy of the frame.
+static void
+push_capture_frame(capture_state *cs, u32 *pixels, u32 frame_index, frame_input input) {
+    u32 write_index = atomic_load_explicit(&cs->queue_write_index, memory_order_relaxed);
+    u32 read_index = atomic_load_explicit(&cs->queue_read_index, memory_order_acquire);
+
+    if (write_index - read_index >= CAPTURE_QUEUE_SIZE) {
+        cs->lost_frame_count += 1;
+        return;
+    }
+
+    capture_entry *entry = cs->queue + (write_index & (CAPTURE_QUEUE_SIZE - 1));
+    entry->frame_index = frame_index;
+    entry->input = input;
+    entry->pool_index = CAPTURE_NO_PIXELS;
+
+    u32 free_read_index = atomic_load_explicit(&cs->free_read_index, memory_order_relaxed);
+    u32 free_write_index = atomic_load_explicit(&cs->free_write_index, memory_order_acquire);
+
+    if (free_read_index != free_write_index) {
+        u32 pool_index = cs->free_ring[free_read_index & (CAPTURE_POOL_SIZE - 1)];
+        atomic_store_explicit(&cs->free_read_index, free_read_index + 1, memory_order_release);
+
+        memcpy(cs->pool[pool_index], pixels, cs->width * cs->height * sizeof(u32));
+        entry->pool_index = pool_index;
+    } else {
+        cs->dropped_frame_count += 1;
+    }
+
+    atomic_store_explicit(&cs->queue_write_index, write_index + 1, memory_order_release);
+    SDL_SemPost(cs->queue_semaphore);
+}
+
+// NOTE: Waits for the writer to finish the queued frames. Returns 1 if every
+// frame made it and matched its golden frame.
+static int
+close_capture(capture_state *cs) {
+    if (cs->thread) {
+        atomic_store_explicit(&cs->is_stopping, 1, memory_order_release);
+        SDL_SemPost(cs->queue_semaphore);
+        SDL_WaitThread(cs->thread, 0);
+        cs->thread = 0;
+    }
+
+    if (cs->queue_semaphore) {
+        SDL_DestroySemaphore(cs->queue_semaphore);
+        cs->queue_semaphore = 0;
+    }
+
+    if (cs->out) {
+        fclose(cs->out);
+        cs->out = 0;
+        SDL_Log("Captured %u frames, %u without pixels, %u lost\n",
+                cs->written_frame_count, cs->dropped_frame_count, cs->lost_frame_count);
+    }
+
+    if (cs->golden) {
+        fclose(cs->golden);
+        cs->golden = 0;
+        SDL_Log("Compared %u frames, %u mismatched, %u missing\n",
+                cs->compared_frame_count, cs->mismatched_frame_count,
+                cs->missing_golden_frame_count + cs->dropped_frame_count + cs->lost_frame_count);
+    }
+
+    int result = cs->mismatched_frame_count == 0 &&
+                 cs->missing_golden_frame_count == 0 &&
+                 cs->dropped_frame_count == 0 &&
+                 cs->lost_frame_count == 0;
+    return result;
+}
+
+// NOTE: Reads the input of every frame of a capture, the pixels are
+// skipped. Fails if the capture lost frames, it cannot be replayed then.
+static int
+load_input_recording(input_recording *rec, memory_arena *arena, const char *path) {
+    *rec = (input_recording) {};
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        logerr("Failed to open %s\n", path);
+        return 0;
+    }
+
+    int result = read_capture_header(file, path, 0, 0);
+    long first_frame = ftell(file);
+
+    // NOTE: The first pass counts the frames, the second reads their input
+    u32 frame_count = 0;
+    capture_frame_header header;
+    while (result && fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.frame_index != frame_count) {
+            logerr("%s has no input for frame %u\n", path, frame_count);
+            result = 0;
+            break;
+        }
+
+        frame_count += 1;
+        result = skip_capture_pixels(file, &header);
+    }
+
+    if (result) {
+        rec->inputs = push_array(arena, frame_count, frame_input);
+        fseek(file, first_frame, SEEK_SET);
+
+        while (rec->frame_count < frame_count && fread(&header, sizeof(header), 1, file) == 1) {
+            rec->inputs[rec->frame_count++] = header.input;
+            skip_capture_pixels(file, &header);
+        }
+    }
+
+    fclose(file);
+    return result;
+}
+
+// NOTE: Compares two captures frame by frame without running the game.
+// Returns the number of frames that differ or are missing, -1 on errors.
+static i32
+diff_captures(memory_arena *arena, const char *path, const char *golden_path) {
+    FILE *file = fopen(path, "rb");
+    FILE *golden = fopen(golden_path, "rb");
+    if (!file || !golden) {
+        logerr("Failed to open %s\n", file ? golden_path : path);
+        if (file) {
+            fclose(file);
+        }
+        if (golden) {
+            fclose(golden);
+        }
+        return -1;
+    }
+
+    capture_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION ||
+        !read_capture_header(golden, golden_path, header.width, header.height))
+    {
+        logerr("Cannot compare %s to %s\n", path, golden_path);
+        fclose(golden);
+        fclose(file);
+        return -1;
+    }
+
+    u32 pixel_count = header.width * header.height;
+    u32 *pixels = push_array(arena, pixel_count, u32);
+    u32 *golden_pixels = push_array(arena, pixel_count, u32);
+    u8 *scratch = push_buffer(arena, pixel_count * sizeof(u32));
+
+    i32 result = 0;
+    u32 compared_count = 0;
+
+    capture_frame_header a;
+    capture_frame_header b;
+    int has_a = fread(&a, sizeof(a), 1, file) == 1;
+    int has_b = fread(&b, sizeof(b), 1, golden) == 1;
+
+    while (has_a || has_b) {
+        if (has_a && (!has_b || a.frame_index < b.frame_index)) {
+            logerr("Frame %u is missing from %s\n", a.frame_index, golden_path);
+            result += 1;
+            skip_capture_pixels(file, &a);
+            has_a = fread(&a, sizeof(a), 1, file) == 1;
+            continue;
+        }
+
+        if (has_b && (!has_a || b.frame_index < a.frame_index)) {
+            logerr("Frame %u is missing from %s\n", b.frame_index, path);
+            result += 1;
+            skip_capture_pixels(golden, &b);
+            has_b = fread(&b, sizeof(b), 1, golden) == 1;
+            continue;
+        }
+
+        if (a.encoding == CAPTURE_ENCODING_NONE || b.encoding == CAPTURE_ENCODING_NONE) {
+            if (a.encoding != b.encoding) {
+                logerr("Frame %u has no pixels in one of the captures\n", a.frame_index);
+                result += 1;
+            }
+            skip_capture_pixels(file, &a);
+            skip_capture_pixels(golden, &b);
+        } else if (a.hash == b.hash) {
+            compared_count += 1;
+            skip_capture_pixels(file, &a);
+            skip_capture_pixels(golden, &b);
+        } else {
+            compared_count += 1;
+            result += 1;
+
+            if (read_capture_pixels(file, &a, pixels, scratch, pixel_count) &&
+                read_capture_pixels(golden, &b, golden_pixels, scratch, pixel_count))
+            {
+                report_frame_difference(a.frame_index, pixels, golden_pixels,
+                                        header.width, header.height);
+            } else {
+                logerr("Failed to read frame %u\n", a.frame_index);
+                result = -1;
+                break;
+            }
+        }
+
+        has_a = fread(&a, sizeof(a), 1, file) == 1;
+        has_b = fread(&b, sizeof(b), 1, golden) == 1;
+    }
+
+    if (result >= 0) {
+        SDL_Log("Compared %u frames, %d differ or are missing\n", compared_count, result);
+    }
+
+    fclose(golden);
+    fclose(file);
+
+    return result;
+}
@@ -0,0 +1,119 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// NOTE: Both must be powers of two. When the writer falls behind by more
+// than the pool the pixels of a frame are dropped, its input still goes
+// through the queue. Nothing is ever waited for.
+#define CAPTURE_POOL_SIZE 16
+#define CAPTURE_QUEUE_SIZE 256
+
+#define CAPTURE_NO_PIXELS 0xFFFFFFFF
+#define CAPTURE_RLE_RUN_BIT 0x80000000
+
+#define CAPTURE_MAGIC 0x50414342 // "BCAP"
+#define CAPTURE_VERSION 1
+
+enum {
+    INPUT_FLAG_MOVE_PADDLE = (1 << 0),
+    INPUT_FLAG_REWIND = (1 << 1),
+    INPUT_FLAG_QUICKSAVE = (1 << 2),
+    INPUT_FLAG_QUICKLOAD = (1 << 3),
+    INPUT_FLAG_NEXT_FILTER = (1 << 4),
+};
+
+// NOTE: Everything that changes the game or the rendered image during one
+// frame. Replaying the same inputs from a fresh start gives the same frames.
+typedef struct {
+    u32 flags;
+    // NOTE: In world units, only valid with INPUT_FLAG_MOVE_PADDLE
+    f32 paddle_x;
+} frame_input;
+
+typedef enum {
+    // NOTE: The pixels of the frame were dropped, only its input is recorded
+    CAPTURE_ENCODING_NONE,
+    CAPTURE_ENCODING_RAW,
+    // NOTE: A sequence of u32 headers. With the top bit set the low bits are
+    // the length of a run of the single pixel that follows, otherwise they
+    // are the number of literal pixels that follow.
+    CAPTURE_ENCODING_RLE,
+} capture_encoding;
+
+// NOTE: A capture file is this header followed by one record per frame, a
+// capture_frame_header and size bytes of pixels in the given encoding. The
+// pixels are the output image, rows stored bottom-up like the framebuffer.
+typedef struct {
+    u32 magic;
+    u32 version;
+    i32 width;
+    i32 height;
+} capture_header;
+
+typedef struct {
+    // NOTE: FNV-1a over the decoded pixels
+    u64 hash;
+    u32 frame_index;
+    u32 encoding;
+    u32 size;
+    u32 reserved;
+    frame_input input;
+} capture_frame_header;
+
+typedef struct {
+    u32 frame_index;
+    // NOTE: Index into the pool or CAPTURE_NO_PIXELS
+    u32 pool_index;
+    frame_input input;
+} capture_entry;
+
+// NOTE: Pool buffers go around in a loop. The game takes a free one, copies
+// the finished image into it and queues it, the writer thread encodes,
+// writes and compares it and hands it back. Both rings are single producer,
+// single consumer, so like the audio command ring they only share their
+// indices.
+typedef struct {
+    i32 width;
+    i32 height;
+
+    u32 *pool[CAPTURE_POOL_SIZE];
+
+    // NOTE: Produced by the writer, consumed by the game
+    u32 free_ring[CAPTURE_POOL_SIZE];
+    _Atomic u32 free_write_index;
+    _Atomic u32 free_read_index;
+
+    // NOTE: Produced by the game, consumed by the writer
+    capture_entry queue[CAPTURE_QUEUE_SIZE];
+    _Atomic u32 queue_write_index;
+    _Atomic u32 queue_read_index;
+
+    SDL_Thread *thread;
+    // NOTE: Posted once per queued frame and once more to stop the writer
+    SDL_sem *queue_semaphore;
+    _Atomic i32 is_stopping;
+
+    // NOTE: Owned by the writer thread
+    FILE *out;
+    FILE *golden;
+    capture_frame_header golden_header;
+    i32 has_golden_header;
+    u8 *encoded;
+    u32 *golden_pixels;
+    u32 written_frame_count;
+    u32 compared_frame_count;
+    u32 mismatched_frame_count;
+    u32 missing_golden_frame_count;
+
+    // NOTE: Owned by the game. Frames without pixels and frames that did not
+    // make it into the queue at all, which breaks a recording.
+    u32 dropped_frame_count;
+    u32 lost_frame_count;
+} capture_state;
+
+// NOTE: The inputs of a capture, read up front for replay
+typedef struct {
+    frame_input *inputs;
+    u32 frame_count;
+} input_recording;
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+typedef enum {
+    PROFILE_COUNTER_FRAME,
+    PROFILE_COUNTER_SNAPSHOT,
+    PROFILE_COUNTER_REWIND,
+    PROFILE_COUNTER_HUD,
+    PROFILE_COUNTER_UPSCALE,
+    PROFILE_COUNTER_CAPTURE,
+
+    PROFILE_COUNTER_COUNT,
+} profile_counter_id;
+
+typedef struct {
+    const char *name;
+    u64 ticks;
+    u64 max_ticks;
+    u32 hits;
+
+    // NOTE: Results of the last report, for display
+    f64 last_avg_us;
+    f64 last_max_us;
+} profile_counter;
+
+static profile_counter profile_counters[PROFILE_COUNTER_COUNT] = {
+    [PROFILE_COUNTER_FRAME] = { "frame" },
+    [PROFILE_COUNTER_SNAPSHOT] = { "snapshot" },
+    [PROFILE_COUNTER_REWIND] = { "rewind" },
+    [PROFILE_COUNTER_HUD] = { "hud" },
+    [PROFILE_COUNTER_UPSCALE] = { "upscale" },
+    [PROFILE_COUNTER_CAPTURE] = { "capture" },
+};
+
+// NOTE: Incremented by every report, to tell when the last results changed
+static u32 profile_report_index;
+
+// NOTE: BEGIN_PROFILE and END_PROFILE must be used in the same scope,
+// END_PROFILE evaluates to the ticks of the sample
+#define BEGIN_PROFILE(id) u64 profile_begin_##id = SDL_GetPerformanceCounter()
+#define END_PROFILE(id) \
+    add_profile_sample(PROFILE_COUNTER_##id, \
+                       SDL_GetPerformanceCounter() - profile_begin_##id)
+
+static inline u64
+add_profile_sample(profile_counter_id id, u64 ticks) {
+    profile_counter *counter = profile_counters + id;
+
+    counter->ticks += ticks;
+    counter->hits += 1;
+    if (ticks > counter->max_ticks) {
+        counter->max_ticks = ticks;
+    }
+
+    return ticks;
+}
+
+static inline f64
+ticks_to_us(u64 ticks) {
+    f64 result = ticks * 1000000.0 / SDL_GetPerformanceFrequency();
+    return result;
+}
+
+static inline f64
+get_profile_counter_avg_us(profile_counter_id id) {
+    profile_counter *counter = profile_counters + id;
+
+    f64 result = 0.0;
+    if (counter->hits) {
+        result = ticks_to_us(counter->ticks) / counter->hits;
+    }
+    return result;
+}
+
+// NOTE: Keeps the average and worst cost of every counter that was hit since
+// the last report, logs them if asked to and starts a new measurement period.
+static inline void
+report_profile_counters(int should_log) {
+    for (u32 id = 0; id < PROFILE_COUNTER_COUNT; ++id) {
+        profile_counter *counter = profile_counters + id;
+
+        counter->last_avg_us = get_profile_counter_avg_us(id);
+        counter->last_max_us = ticks_to_us(counter->max_ticks);
+
+        if (should_log && counter->hits) {
+            SDL_Log("%-12s avg %9.2fus max %9.2fus hits %6u\n",
+                    counter->name,
+                    counter->last_avg_us,
+                    counter->last_max_us,
+                    counter->hits);
+        }
+
+        counter->ticks = 0;
+        counter->max_ticks = 0;
+        counter->hits = 0;
+    }
+
+    profile_report_index += 1;
+}
+
+#endif
@@ -1,7 +1,10 @@
-#define GAMMA 2.2f
+// NOTE: The same curve the blend kernel uses, see premultiply_u32, so that
+// gradients and blended pixels agree. Against the real sRGB curve the 8-bit
+// encoding is off by up to 10 codes, in the darkest tones.
+#define GAMMA 2.0f
 
-static u32
-u32_linear_to_srgb(u32 color) {
+static u8 *
+get_linear_to_srgb_table() {
     static u8 gamma_correction_table[256];
     static u32 is_gamma_correction_table_initialized;
 
@@ -17,17 +20,7 @@ u32_linear_to_srgb(u32 color) {
         is_gamma_correction_table_initialized = 1;
     }
 
-    u8 r = getu32red(color);
-    u8 g = getu32green(color);
-    u8 b = getu32blue(color);
-    u8 a = getu32alpha(color);
-
-    u32 result = u32rgba(gamma_correction_table[r],
-                         gamma_correction_table[g],
-                         gamma_correction_table[b],
-                         a);
-
-    return result;
+    return gamma_correction_table;
 }
 
 static u32
@@ -62,80 +55,868 @@ u32_srgb_to_linear(u32 color) {
 
 static void
 copy_pixels_to_texture(render_context *ctx) {
-    SDL_UpdateTexture(ctx->texture, 0, ctx->buf, ctx->width * 4);
+    SDL_UpdateTexture(ctx->texture, 0, ctx->present_buf, ctx->output_width * 4);
+}
+
+// NOTE: A color with 16 fractional bits per 8-bit channel, so gradients can
+// be stepped incrementally without any float work per pixel
+typedef struct {
+    i32 r;
+    i32 g;
+    i32 b;
+    i32 a;
+} fixed_color;
+
+static inline fixed_color
+rgba_to_fixed(vec4 color) {
+    fixed_color result;
+
+    result.r = (i32)(color.r * 255.0f * 65536.0f);
+    result.g = (i32)(color.g * 255.0f * 65536.0f);
+    result.b = (i32)(color.b * 255.0f * 65536.0f);
+    result.a = (i32)(color.a * 255.0f * 65536.0f);
+
+    return result;
+}
+
+static inline fixed_color
+get_fixed_step(fixed_color from, fixed_color to, i32 count) {
+    fixed_color result = {};
+
+    if (count > 0) {
+        result.r = (to.r - from.r) / count;
+        result.g = (to.g - from.g) / count;
+        result.b = (to.b - from.b) / count;
+        result.a = (to.a - from.a) / count;
+    }
+
+    return result;
+}
+
+static inline fixed_color
+add_fixed_steps(fixed_color color, fixed_color step, i32 count) {
+    fixed_color result;
+
+    result.r = color.r + step.r * count;
+    result.g = color.g + step.g * count;
+    result.b = color.b + step.b * count;
+    result.a = color.a + step.a * count;
+
+    return result;
+}
+
+static inline u32
+fixed_to_u32(fixed_color color, u8 *gamma_table) {
+    u8 r = color.r >> 16;
+    u8 g = color.g >> 16;
+    u8 b = color.b >> 16;
+    u8 a = color.a >> 16;
+
+    if (gamma_table) {
+        r = gamma_table[r];
+        g = gamma_table[g];
+        b = gamma_table[b];
+    }
+
+    u32 result = u32rgba(r, g, b, a);
+    return result;
 }
 
 static void
-render_rect(render_context *ctx, rect2 rect, vec4 rgba) {
-    i32 minx = (i32)rect.min.x;
-    i32 miny = (i32)rect.min.y;
-    i32 maxx = (i32)rect.max.x;
-    i32 maxy = (i32)rect.max.y;
+fill_span(u32 *pixel, i32 count, u32 color) {
+    i32 i = 0;
 
-    if (minx < 0) { minx = 0; }
-    if (maxx >= ctx->width) { maxx = ctx->width; }
-    if (miny < 0) { miny = 0; }
-    if (maxy >= ctx->height) { maxy = ctx->height; }
+#if MATH_SSE2
+    __m128i c = _mm_set1_epi32(color);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(pixel + i), c);
+    }
+#elif MATH_NEON
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32(pixel + i, c);
+    }
+#endif
 
-    u32 color = rgba_to_u32(rgba);
-    u32 *row = ctx->buf + (ctx->height - 1 - miny) * ctx->width + minx;
-    for (i32 y = miny; y < maxy; ++y) {
-        u32 *pixel = row;
-        for (i32 x = minx; x < maxx; ++x) {
-            *pixel++ = color;
+    for (; i < count; ++i) {
+        pixel[i] = color;
+    }
+}
+
+static void
+render_shaded_span(u32 *pixel, i32 count, fixed_color color, fixed_color step, u8 *gamma_table) {
+#if MATH_SSE2
+    if (!gamma_table) {
+        // NOTE: Lanes are (a, b, g, r) so that the packed bytes read as
+        // 0xRRGGBBAA, four pixels per iteration
+        __m128i c0 = _mm_setr_epi32(color.a, color.b, color.g, color.r);
+        __m128i dc = _mm_setr_epi32(step.a, step.b, step.g, step.r);
+        __m128i c1 = _mm_add_epi32(c0, dc);
+        __m128i c2 = _mm_add_epi32(c1, dc);
+        __m128i c3 = _mm_add_epi32(c2, dc);
+        __m128i dc4 = _mm_slli_epi32(dc, 2);
+
+        i32 i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i p01 = _mm_packs_epi32(_mm_srai_epi32(c0, 16), _mm_srai_epi32(c1, 16));
+            __m128i p23 = _mm_packs_epi32(_mm_srai_epi32(c2, 16), _mm_srai_epi32(c3, 16));
+            _mm_storeu_si128((__m128i *)(pixel + i), _mm_packus_epi16(p01, p23));
+
+            c0 = _mm_add_epi32(c0, dc4);
+            c1 = _mm_add_epi32(c1, dc4);
+            c2 = _mm_add_epi32(c2, dc4);
+            c3 = _mm_add_epi32(c3, dc4);
         }
-        row -= ctx->width;
+
+        color = add_fixed_steps(color, step, i);
+        pixel += i;
+        count -= i;
     }
+#endif
+
+    for (i32 i = 0; i < count; ++i) {
+        *pixel++ = fixed_to_u32(color, gamma_table);
+
+        color.r += step.r;
+        color.g += step.g;
+        color.b += step.b;
+        color.a += step.a;
+    }
+}
+
+static int
+is_rgba_equal(vec4 l, vec4 r) {
+    int result = l.r == r.r && l.g == r.g && l.b == r.b && l.a == r.a;
+    return result;
 }
 
+// NOTE: Colors are computed once per span, in fixed point, and never per
+// pixel: a horizontal gradient is rendered as one span that is copied down
+// the rect, a vertical one as one solid color per row.
 static void
-render_gradient_rect(render_context *ctx, rect2 rect) {
-    i32 minx = (i32) (rect.min.x);
-    i32 miny = (i32) (rect.min.y);
-    i32 maxx = (i32) (rect.max.x);
-    i32 maxy = (i32) (rect.max.y);
+render_shaded_rect(render_context *ctx, rect2 rect, shade s) {
+    rect = rect_to_pixels(ctx, rect);
+
+    // NOTE: The gradient runs over the whole rect, not just its visible part
+    i32 rminx = (i32)rect.min.x;
+    i32 rminy = (i32)rect.min.y;
+    i32 rmaxx = (i32)rect.max.x;
+    i32 rmaxy = (i32)rect.max.y;
+
+    i32 minx = rminx;
+    i32 miny = rminy;
+    i32 maxx = rmaxx;
+    i32 maxy = rmaxy;
 
     if (minx < 0) { minx = 0; }
     if (maxx >= ctx->width) { maxx = ctx->width; }
     if (miny < 0) { miny = 0; }
     if (maxy >= ctx->height) { maxy = ctx->height; }
 
+    if (minx >= maxx || miny >= maxy) {
+        return;
+    }
+
+    u8 *gamma_table = 0;
+    if (s.flags & SHADE_FLAG_GAMMA_CORRECT) {
+        gamma_table = get_linear_to_srgb_table();
+    }
+
+    i32 width = maxx - minx;
+    i32 rwidth = rmaxx - rminx;
+    i32 rheight = rmaxy - rminy;
+
+    fixed_color bottom_left = rgba_to_fixed(s.bottom_left);
+    fixed_color bottom_right = rgba_to_fixed(s.bottom_right);
+    fixed_color top_left = rgba_to_fixed(s.top_left);
+    fixed_color top_right = rgba_to_fixed(s.top_right);
+
+    fixed_color left_step = get_fixed_step(bottom_left, top_left, rheight);
+    fixed_color right_step = get_fixed_step(bottom_right, top_right, rheight);
+    fixed_color left = add_fixed_steps(bottom_left, left_step, miny - rminy);
+    fixed_color right = add_fixed_steps(bottom_right, right_step, miny - rminy);
+
     u32 *row = ctx->buf + (ctx->height - 1 - miny) * ctx->width + minx;
-    i32 size = maxx - minx;
-    for (i32 y = miny; y < maxy; ++y) {
-        u32 *pixel = row;
-        for (i32 x = minx; x < maxx; ++x) {
-            f32 intensity = (x - minx) * 1.0f / size;
-            u32 color = rgba_to_u32(rgba(intensity, intensity, intensity, 1.0f));
-            color = u32_linear_to_srgb(color);
-            *pixel++ = color;
-        }
+
+    if (is_rgba_equal(s.bottom_left, s.top_left) &&
+        is_rgba_equal(s.bottom_right, s.top_right))
+    {
+        // NOTE: Every row is the same span
+        fixed_color step = get_fixed_step(left, right, rwidth);
+        fixed_color color = add_fixed_steps(left, step, minx - rminx);
+
+        u32 *first_row = row;
+        render_shaded_span(first_row, width, color, step, gamma_table);
         row -= ctx->width;
+
+        for (i32 y = miny + 1; y < maxy; ++y) {
+            memcpy(row, first_row, width * sizeof(*row));
+            row -= ctx->width;
+        }
+    } else if (is_rgba_equal(s.bottom_left, s.bottom_right) &&
+               is_rgba_equal(s.top_left, s.top_right))
+    {
+        // NOTE: Every row is a solid color
+        for (i32 y = miny; y < maxy; ++y) {
+            fill_span(row, width, fixed_to_u32(left, gamma_table));
+
+            left = add_fixed_steps(left, left_step, 1);
+            row -= ctx->width;
+        }
+    } else {
+        for (i32 y = miny; y < maxy; ++y) {
+            fixed_color step = get_fixed_step(left, right, rwidth);
+            fixed_color color = add_fixed_steps(left, step, minx - rminx);
+            render_shaded_span(row, width, color, step, gamma_table);
+
+            left = add_fixed_steps(left, left_step, 1);
+            right = add_fixed_steps(right, right_step, 1);
+            row -= ctx->width;
+        }
+    }
+}
+
+// NOTE: Blending happens in linear space with gamma 2.0 standing in for the
+// real sRGB curve: a channel is squared to go to linear and square rooted to
+// come back. Unlike table lookups that needs no gathers, so it vectorizes,
+// and with SSE2 a 4-wide float square root beats a 64K entry table read one
+// channel at a time.
+//
+// Blend sources are premultiplied in linear space and then encoded back, i.e.
+// a channel c with alpha a is stored as sqrt(c^2 * a). The alpha channel
+// itself is stored as is.
+static u32
+premultiply_u32(u32 color) {
+    u8 a = getu32alpha(color);
+
+    u8 r = sqrtf(getu32red(color) * getu32red(color) * (a / 255.0f)) + 0.5f;
+    u8 g = sqrtf(getu32green(color) * getu32green(color) * (a / 255.0f)) + 0.5f;
+    u8 b = sqrtf(getu32blue(color) * getu32blue(color) * (a / 255.0f)) + 0.5f;
+
+    u32 result = u32rgba(r, g, b, a);
+    return result;
+}
+
+typedef enum {
+    // NOTE: dst = src + dst * (1 - src.a)
+    BLEND_MODE_OVER,
+    // NOTE: dst = src + dst
+    BLEND_MODE_ADD,
+} blend_mode;
+
+// NOTE: Scalar reference of the SIMD kernel below, the results are the same
+// bit for bit. Channels are in 0xRRGGBBAA order.
+static inline u32
+blend_premultiplied_pixel(u32 dst, u32 src, blend_mode mode) {
+    u32 inv_alpha = (255 - getu32alpha(src)) * 257;
+
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 d = (dst >> shift) & 0xFF;
+        u32 s = (src >> shift) & 0xFF;
+
+        // NOTE: Alpha is linear already, only scale it to the same range
+        u32 dst_linear = shift == ASHIFT ? d * 255 : d * d;
+        u32 src_linear = shift == ASHIFT ? s * 255 : s * s;
+
+        if (mode == BLEND_MODE_OVER) {
+            dst_linear = (dst_linear * inv_alpha) >> 16;
+        }
+
+        u32 linear = src_linear + dst_linear;
+        if (linear > 0xFFFF) {
+            linear = 0xFFFF;
+        }
+
+        f32 value = shift == ASHIFT ? linear * (1.0f / 255.0f) : sqrtf((f32)linear);
+        u32 out = (u32)(value + 0.5f);
+        if (out > 255) {
+            out = 255;
+        }
+
+        result |= out << shift;
     }
+
+    return result;
+}
+
+#if MATH_SSE2
+// NOTE: Converts 8 channels (2 pixels) to the blend space, see above
+static inline __m128i
+blend_to_linear_epu16(__m128i c, __m128i alpha_mask, __m128i alpha_scale) {
+    __m128i factor = _mm_or_si128(_mm_andnot_si128(alpha_mask, c), alpha_scale);
+    __m128i result = _mm_mullo_epi16(c, factor);
+    return result;
+}
+
+// NOTE: Converts 4 channels (1 pixel) back from the blend space
+static inline __m128i
+blend_from_linear_epi32(__m128i linear, __m128 alpha_mask) {
+    __m128 f = _mm_cvtepi32_ps(linear);
+    __m128 color = _mm_sqrt_ps(f);
+    __m128 alpha = _mm_mul_ps(f, _mm_set1_ps(1.0f / 255.0f));
+    __m128 value = _mm_or_ps(_mm_andnot_ps(alpha_mask, color), _mm_and_ps(alpha_mask, alpha));
+    __m128i result = _mm_cvttps_epi32(_mm_add_ps(value, _mm_set1_ps(0.5f)));
+    return result;
+}
+#endif
+
+// NOTE: Blends count pixels of src onto dst. With src_step 0 the same source
+// pixel is used for the whole span.
+static void
+blend_premultiplied_span(u32 *dst, u32 *src, i32 src_step, i32 count, blend_mode mode) {
+    i32 i = 0;
+
+#if MATH_SSE2
+    __m128i zero = _mm_setzero_si128();
+    // NOTE: Lanes are (a, b, g, r) per pixel, see rgba_to_abgr_epi32
+    __m128i alpha_mask = _mm_setr_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i alpha_scale = _mm_and_si128(alpha_mask, _mm_set1_epi16(255));
+    __m128 alpha_mask_ps = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, 0, 0));
+    __m128i max_alpha = _mm_set1_epi16(255);
+    __m128i alpha_to_16 = _mm_set1_epi16(257);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i s;
+        if (src_step) {
+            s = _mm_loadu_si128((__m128i *)(src + i));
+        } else {
+            s = _mm_set1_epi32(*src);
+        }
+        __m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+        __m128i src_lo = blend_to_linear_epu16(s_lo, alpha_mask, alpha_scale);
+        __m128i src_hi = blend_to_linear_epu16(s_hi, alpha_mask, alpha_scale);
+        __m128i dst_lo = blend_to_linear_epu16(d_lo, alpha_mask, alpha_scale);
+        __m128i dst_hi = blend_to_linear_epu16(d_hi, alpha_mask, alpha_scale);
+
+        if (mode == BLEND_MODE_OVER) {
+            // NOTE: Broadcast the alpha of every pixel to its four lanes
+            __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0), 0);
+            __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0), 0);
+            __m128i inv_lo = _mm_mullo_epi16(_mm_sub_epi16(max_alpha, a_lo), alpha_to_16);
+            __m128i inv_hi = _mm_mullo_epi16(_mm_sub_epi16(max_alpha, a_hi), alpha_to_16);
+            dst_lo = _mm_mulhi_epu16(dst_lo, inv_lo);
+            dst_hi = _mm_mulhi_epu16(dst_hi, inv_hi);
+        }
+
+        __m128i out_lo = _mm_adds_epu16(src_lo, dst_lo);
+        __m128i out_hi = _mm_adds_epu16(src_hi, dst_hi);
+
+        __m128i p0 = blend_from_linear_epi32(_mm_unpacklo_epi16(out_lo, zero), alpha_mask_ps);
+        __m128i p1 = blend_from_linear_epi32(_mm_unpackhi_epi16(out_lo, zero), alpha_mask_ps);
+        __m128i p2 = blend_from_linear_epi32(_mm_unpacklo_epi16(out_hi, zero), alpha_mask_ps);
+        __m128i p3 = blend_from_linear_epi32(_mm_unpackhi_epi16(out_hi, zero), alpha_mask_ps);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        _mm_storeu_si128((__m128i *)(dst + i), packed);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        dst[i] = blend_premultiplied_pixel(dst[i], src[i * src_step], mode);
+    }
+}
+
+// NOTE: Rect bounds are rasterized in 24.8 fixed point
+#define COVERAGE_ONE 256
+
+// NOTE: How much of the pixel cell [i, i + 1) the span [from, to) covers,
+// from 0 to COVERAGE_ONE
+static inline i32
+get_cell_coverage(i32 i, i32 from, i32 to) {
+    i32 cell_min = i * COVERAGE_ONE;
+    i32 cell_max = cell_min + COVERAGE_ONE;
+
+    i32 result = (to < cell_max ? to : cell_max) - (from > cell_min ? from : cell_min);
+    if (result < 0) {
+        result = 0;
+    }
+    return result;
+}
+
+// NOTE: The premultiplied color with its alpha scaled by coverage
+static inline u32
+get_coverage_color(u32 color, i32 coverage) {
+    u8 alpha = (getu32alpha(color) * coverage + COVERAGE_ONE / 2) / COVERAGE_ONE;
+    u32 result = premultiply_u32(setu32alpha(color, alpha));
+    return result;
+}
+
+#define COVERAGE_COLUMN_CHUNK_SIZE 64
+
+// NOTE: Blends one color down a column of the framebuffer. The column is
+// gathered into a chunk first so it goes through the SIMD kernel like a row.
+static void
+blend_premultiplied_column(u32 *pixel, i32 stride, i32 count, u32 color, blend_mode mode) {
+    u32 chunk[COVERAGE_COLUMN_CHUNK_SIZE];
+
+    for (i32 i = 0; i < count; i += COVERAGE_COLUMN_CHUNK_SIZE) {
+        i32 chunk_count = count - i;
+        if (chunk_count > COVERAGE_COLUMN_CHUNK_SIZE) {
+            chunk_count = COVERAGE_COLUMN_CHUNK_SIZE;
+        }
+
+        u32 *at = pixel + i * stride;
+        for (i32 j = 0; j < chunk_count; ++j) {
+            chunk[j] = at[j * stride];
+        }
+
+        blend_premultiplied_span(chunk, &color, 0, chunk_count, mode);
+
+        for (i32 j = 0; j < chunk_count; ++j) {
+            at[j * stride] = chunk[j];
+        }
+    }
+}
+
+// NOTE: Blends a row that is only partially covered vertically, including
+// its corner pixels
+static void
+render_coverage_edge_row(u32 *row, i32 pminx, i32 pmaxx, i32 inner_minx, i32 inner_maxx,
+                         i32 left_coverage, i32 right_coverage, i32 coverage,
+                         u32 color, blend_mode mode)
+{
+    if (inner_minx > pminx) {
+        u32 corner = get_coverage_color(color, left_coverage * coverage / COVERAGE_ONE);
+        row[pminx] = blend_premultiplied_pixel(row[pminx], corner, mode);
+    }
+
+    u32 edge = get_coverage_color(color, coverage);
+    blend_premultiplied_span(row + inner_minx, &edge, 0, inner_maxx - inner_minx, mode);
+
+    if (inner_maxx < pmaxx) {
+        u32 corner = get_coverage_color(color, right_coverage * coverage / COVERAGE_ONE);
+        row[pmaxx - 1] = blend_premultiplied_pixel(row[pmaxx - 1], corner, mode);
+    }
+}
+
+// NOTE: Pixels are weighted by the area of them the rect covers. Only the
+// first and last row and column can be partially covered, every pixel in
+// between takes the span path the rect would take without anti-aliasing:
+// a plain fill for opaque colors or one constant color blended per row.
+// A rect on whole pixels has no partial edges at all.
+static void
+render_coverage_rect(render_context *ctx, rect2 rect, u32 color, blend_mode mode) {
+    // NOTE: Clip in float, so the conversion never overflows
+    f32 minx = rect.min.x < 0.0f ? 0.0f : rect.min.x;
+    f32 miny = rect.min.y < 0.0f ? 0.0f : rect.min.y;
+    f32 maxx = rect.max.x > ctx->width ? ctx->width : rect.max.x;
+    f32 maxy = rect.max.y > ctx->height ? ctx->height : rect.max.y;
+
+    if (minx >= maxx || miny >= maxy) {
+        return;
+    }
+
+    i32 fminx = (i32)(minx * COVERAGE_ONE + 0.5f);
+    i32 fminy = (i32)(miny * COVERAGE_ONE + 0.5f);
+    i32 fmaxx = (i32)(maxx * COVERAGE_ONE + 0.5f);
+    i32 fmaxy = (i32)(maxy * COVERAGE_ONE + 0.5f);
+
+    if (fminx >= fmaxx || fminy >= fmaxy) {
+        return;
+    }
+
+    // NOTE: Every pixel that is at least partially covered
+    i32 pminx = fminx / COVERAGE_ONE;
+    i32 pminy = fminy / COVERAGE_ONE;
+    i32 pmaxx = (fmaxx + COVERAGE_ONE - 1) / COVERAGE_ONE;
+    i32 pmaxy = (fmaxy + COVERAGE_ONE - 1) / COVERAGE_ONE;
+
+    // NOTE: A rect within a single column or row only has a left or bottom
+    // edge, which then is partial on both sides
+    i32 left_coverage = get_cell_coverage(pminx, fminx, fmaxx);
+    i32 right_coverage = get_cell_coverage(pmaxx - 1, fminx, fmaxx);
+    i32 inner_minx = pminx + (left_coverage < COVERAGE_ONE);
+    i32 inner_maxx = pmaxx - (right_coverage < COVERAGE_ONE && pmaxx - pminx > 1);
+
+    i32 bottom_coverage = get_cell_coverage(pminy, fminy, fmaxy);
+    i32 top_coverage = get_cell_coverage(pmaxy - 1, fminy, fmaxy);
+    i32 inner_miny = pminy + (bottom_coverage < COVERAGE_ONE);
+    i32 inner_maxy = pmaxy - (top_coverage < COVERAGE_ONE && pmaxy - pminy > 1);
+
+    u32 *bottom_row = ctx->buf + (ctx->height - 1 - pminy) * ctx->width;
+
+    if (inner_miny > pminy) {
+        render_coverage_edge_row(bottom_row, pminx, pmaxx, inner_minx, inner_maxx,
+                                 left_coverage, right_coverage, bottom_coverage, color, mode);
+    }
+
+    if (inner_maxy < pmaxy) {
+        u32 *top_row = bottom_row - (pmaxy - 1 - pminy) * ctx->width;
+        render_coverage_edge_row(top_row, pminx, pmaxx, inner_minx, inner_maxx,
+                                 left_coverage, right_coverage, top_coverage, color, mode);
+    }
+
+    if (inner_miny >= inner_maxy) {
+        return;
+    }
+
+    u32 *row = bottom_row - (inner_miny - pminy) * ctx->width;
+    i32 inner_height = inner_maxy - inner_miny;
+
+    if (inner_minx > pminx) {
+        blend_premultiplied_column(row + pminx, -ctx->width, inner_height,
+                                   get_coverage_color(color, left_coverage), mode);
+    }
+
+    if (inner_maxx < pmaxx) {
+        blend_premultiplied_column(row + pmaxx - 1, -ctx->width, inner_height,
+                                   get_coverage_color(color, right_coverage), mode);
+    }
+
+    if (mode == BLEND_MODE_OVER && getu32alpha(color) == 255) {
+        for (i32 y = inner_miny; y < inner_maxy; ++y) {
+            fill_span(row + inner_minx, inner_maxx - inner_minx, color);
+            row -= ctx->width;
+        }
+    } else {
+        u32 inner_color = get_coverage_color(color, COVERAGE_ONE);
+        for (i32 y = inner_miny; y < inner_maxy; ++y) {
+            blend_premultiplied_span(row + inner_minx, &inner_color, 0, inner_maxx - inner_minx, mode);
+            row -= ctx->width;
+        }
+    }
+}
+
+// NOTE: Opaque colors are filled directly, anything else is blended over
+static void
+render_rect(render_context *ctx, rect2 rect, vec4 rgba) {
+    u32 color = rgba_to_u32(rgba);
+
+    if (getu32alpha(color) == 0) {
+        return;
+    }
+
+    render_coverage_rect(ctx, rect_to_pixels(ctx, rect), color, BLEND_MODE_OVER);
+}
+
+static void
+render_gradient_rect(render_context *ctx, rect2 rect) {
+    shade s = shade_horizontal(rgba(0.0f, 0.0f, 0.0f, 1.0f),
+                               rgba(1.0f, 1.0f, 1.0f, 1.0f),
+                               SHADE_FLAG_GAMMA_CORRECT);
+    render_shaded_rect(ctx, rect, s);
 }
 
 static void
 render_gradient_rect_without_gamma_correction(render_context *ctx, rect2 rect) {
-    i32 minx = (i32) (rect.min.x);
-    i32 miny = (i32) (rect.min.y);
-    i32 maxx = (i32) (rect.max.x);
-    i32 maxy = (i32) (rect.max.y);
+    shade s = shade_horizontal(rgba(0.0f, 0.0f, 0.0f, 1.0f),
+                               rgba(1.0f, 1.0f, 1.0f, 1.0f),
+                               0);
+    render_shaded_rect(ctx, rect, s);
+}
 
-    if (minx < 0) { minx = 0; }
-    if (maxx >= ctx->width) { maxx = ctx->width; }
-    if (miny < 0) { miny = 0; }
-    if (maxy >= ctx->height) { maxy = ctx->height; }
+static void
+init_render_context(render_context *ctx, memory_arena *arena,
+                    SDL_Renderer *renderer, SDL_Texture *texture,
+                    i32 output_width, i32 output_height, i32 max_width, i32 max_height)
+{
+    *ctx = (render_context) {};
 
-    u32 *row = ctx->buf + (ctx->height - 1 - miny) * ctx->width + minx;
-    i32 size = maxx - minx;
-    for (i32 y = miny; y < maxy; ++y) {
-        u32 *pixel = row;
-        for (i32 x = minx; x < maxx; ++x) {
-            f32 intensity = (x - minx) * 1.0f / size;
-            u32 color = rgba_to_u32(rgba(intensity, intensity, intensity, 1.0f));
-            *pixel++ = color;
+    ctx->renderer = renderer;
+    ctx->texture = texture;
+    ctx->max_width = max_width;
+    ctx->max_height = max_height;
+    ctx->buf = push_array(arena, max_width * max_height, u32);
+
+    ctx->output_width = output_width;
+    ctx->output_height = output_height;
+    ctx->output_buf = push_array(arena, output_width * output_height, u32);
+    ctx->present_buf = ctx->output_buf;
+
+    ctx->filter = UPSCALE_FILTER_BILINEAR;
+    ctx->upscale_columns = push_array(arena, output_width, i32);
+    ctx->upscale_weights = push_array(arena, output_width * 8, u16);
+    ctx->upscale_row = push_array(arena, max_width + 1, u32);
+}
+
+// NOTE: Maps output pixel index i to the source in 16.16 fixed point so that
+// pixel centers line up, i.e. (i + 0.5) * src_count / dst_count - 0.5,
+// clamped to the first and last source pixel.
+static i32
+get_upscale_source(i32 i, i32 src_count, i32 dst_count) {
+    i64 result = ((i64)(2 * i + 1) * src_count << 16) / (2 * dst_count) - (1 << 15);
+
+    if (result < 0) {
+        result = 0;
+    }
+    if (result > (i64)(src_count - 1) << 16) {
+        result = (i64)(src_count - 1) << 16;
+    }
+
+    return (i32)result;
+}
+
+// NOTE: The world to pixel scale is passed in, the renderer does not know
+// the size of the world
+static void
+set_render_resolution(render_context *ctx, i32 width, i32 height, f32 units_to_pixels) {
+    assert(width > 0 && width <= ctx->max_width);
+    assert(height > 0 && height <= ctx->max_height);
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pitch = width * 4;
+    ctx->units_to_pixels = units_to_pixels;
+
+    for (i32 x = 0; x < ctx->output_width; ++x) {
+        i32 column = get_upscale_source(x, width, ctx->output_width);
+        ctx->upscale_columns[x] = column;
+
+        // NOTE: 8 bits of weight are plenty for an upscale and keep every
+        // product within 16 bits
+        u16 right = (column >> 8) & 0xFF;
+        u16 left = 256 - right;
+        u16 *weights = ctx->upscale_weights + x * 8;
+        for (u32 i = 0; i < 4; ++i) {
+            weights[i] = left;
+            weights[i + 4] = right;
         }
-        row -= ctx->width;
+    }
+}
+
+static void
+upscale_nearest(render_context *ctx) {
+    u32 *dst = ctx->output_buf;
+    i32 prev_src_y = -1;
+
+    for (i32 y = 0; y < ctx->output_height; ++y) {
+        i32 src_y = (get_upscale_source(y, ctx->height, ctx->output_height) + (1 << 15)) >> 16;
+
+        if (src_y == prev_src_y) {
+            // NOTE: Repeated rows are copies of the row above
+            memcpy(dst, dst - ctx->output_width, ctx->output_width * sizeof(u32));
+            dst += ctx->output_width;
+            continue;
+        }
+        prev_src_y = src_y;
+
+        u32 *src = ctx->buf + src_y * ctx->width;
+        i32 x = 0;
+
+#if MATH_SSE2
+        if (ctx->output_width == 2 * ctx->width) {
+            // NOTE: Exact doubling, every source pixel is stored twice
+            for (; x + 8 <= ctx->output_width; x += 8) {
+                __m128i s = _mm_loadu_si128((__m128i *)(src + x / 2));
+                _mm_storeu_si128((__m128i *)(dst + x), _mm_unpacklo_epi32(s, s));
+                _mm_storeu_si128((__m128i *)(dst + x + 4), _mm_unpackhi_epi32(s, s));
+            }
+        }
+#endif
+
+        for (; x < ctx->output_width; ++x) {
+            dst[x] = src[(ctx->upscale_columns[x] + (1 << 15)) >> 16];
+        }
+
+        dst += ctx->output_width;
+    }
+}
+
+// NOTE: Per channel (l * (256 - w) + r * w) / 256, the SIMD paths below
+// compute the exact same thing
+static inline u32
+lerp_u32(u32 l, u32 r, u32 w) {
+    u32 result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 lc = (l >> shift) & 0xFF;
+        u32 rc = (r >> shift) & 0xFF;
+        result |= ((lc * (256 - w) + rc * w) >> 8) << shift;
+    }
+    return result;
+}
+
+static void
+lerp_rows(u32 *dst, u32 *top, u32 *bottom, u32 w, i32 count) {
+    i32 i = 0;
+
+#if MATH_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i top_weight = _mm_set1_epi16(256 - w);
+    __m128i bottom_weight = _mm_set1_epi16(w);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i t = _mm_loadu_si128((__m128i *)(top + i));
+        __m128i b = _mm_loadu_si128((__m128i *)(bottom + i));
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), top_weight),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), bottom_weight));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), top_weight),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), bottom_weight));
+
+        lo = _mm_srli_epi16(lo, 8);
+        hi = _mm_srli_epi16(hi, 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        dst[i] = lerp_u32(top[i], bottom[i], w);
+    }
+}
+
+// NOTE: Separable, every output row first blends its two source rows into
+// upscale_row, which is then sampled horizontally per output pixel
+static void
+upscale_bilinear(render_context *ctx) {
+    u32 *dst = ctx->output_buf;
+    u32 *row = ctx->upscale_row;
+
+    for (i32 y = 0; y < ctx->output_height; ++y) {
+        i32 src_y = get_upscale_source(y, ctx->height, ctx->output_height);
+        u32 *top = ctx->buf + (src_y >> 16) * ctx->width;
+        u32 w = (src_y >> 8) & 0xFF;
+
+        if (w) {
+            lerp_rows(row, top, top + ctx->width, w, ctx->width);
+        } else {
+            memcpy(row, top, ctx->width * sizeof(u32));
+        }
+        // NOTE: The last column is sampled with a zero weight on its right
+        // neighbour, which must still be readable
+        row[ctx->width] = row[ctx->width - 1];
+
+        i32 x = 0;
+
+#if MATH_SSE2
+        __m128i zero = _mm_setzero_si128();
+
+        for (; x + 2 <= ctx->output_width; x += 2) {
+            // NOTE: Each load is a pair of neighbouring source pixels
+            __m128i p0 = _mm_loadl_epi64((__m128i *)(row + (ctx->upscale_columns[x] >> 16)));
+            __m128i p1 = _mm_loadl_epi64((__m128i *)(row + (ctx->upscale_columns[x + 1] >> 16)));
+            __m128i w0 = _mm_loadu_si128((__m128i *)(ctx->upscale_weights + x * 8));
+            __m128i w1 = _mm_loadu_si128((__m128i *)(ctx->upscale_weights + x * 8 + 8));
+
+            __m128i m0 = _mm_mullo_epi16(_mm_unpacklo_epi8(p0, zero), w0);
+            __m128i m1 = _mm_mullo_epi16(_mm_unpacklo_epi8(p1, zero), w1);
+
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(m0, m1), _mm_unpackhi_epi64(m0, m1));
+            sum = _mm_srli_epi16(sum, 8);
+            _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+
+        for (; x < ctx->output_width; ++x) {
+            i32 column = ctx->upscale_columns[x];
+            u32 *p = row + (column >> 16);
+            dst[x] = lerp_u32(p[0], p[1], (column >> 8) & 0xFF);
+        }
+
+        dst += ctx->output_width;
+    }
+}
+
+// NOTE: Brings the internal resolution image to the output resolution. Must
+// be called once the game is rendered and before render_to_screen.
+static void
+upscale_frame(render_context *ctx) {
+    if (ctx->width == ctx->output_width && ctx->height == ctx->output_height) {
+        ctx->present_buf = ctx->buf;
+        return;
+    }
+
+    ctx->present_buf = ctx->output_buf;
+    if (ctx->filter == UPSCALE_FILTER_NEAREST) {
+        upscale_nearest(ctx);
+    } else {
+        upscale_bilinear(ctx);
+    }
+}
+
+// NOTE: A context that renders into the image that is about to be shown,
+// for overlays which should stay sharp whatever the internal resolution is
+static render_context
+get_output_context(render_context *ctx) {
+    render_context result = *ctx;
+
+    result.buf = ctx->present_buf;
+    result.width = ctx->output_width;
+    result.height = ctx->output_height;
+    result.pitch = ctx->output_width * 4;
+    result.units_to_pixels = ctx->units_to_pixels * ctx->output_width / ctx->width;
+
+    return result;
+}
+
+// NOTE: Rounded to the nearest pixel, truncating would turn 800 * 0.7f into
+// 559 since 0.7f is slightly below 0.7
+static inline i32
+scale_resolution(i32 size, f32 fraction) {
+    i32 result = (i32)(size * fraction + 0.5f);
+    if (result < 1) {
+        result = 1;
+    }
+    return result;
+}
+
+// NOTE: The resolution the context is set to when this is called is the base
+// one, the levels are fractions of it
+static void
+init_dynamic_resolution(dynamic_resolution *dr, render_context *ctx, f64 budget_us) {
+    *dr = (dynamic_resolution) {};
+
+    dr->is_enabled = 1;
+    dr->budget_us = budget_us;
+    dr->base_width = ctx->width;
+    dr->base_height = ctx->height;
+    dr->base_units_to_pixels = ctx->units_to_pixels;
+}
+
+static void
+set_dynamic_resolution_level(dynamic_resolution *dr, render_context *ctx, u32 level) {
+    assert(level < count(dynamic_resolution_levels));
+
+    f32 fraction = dynamic_resolution_levels[level];
+    i32 width = scale_resolution(dr->base_width, fraction);
+    i32 height = scale_resolution(dr->base_height, fraction);
+
+    set_render_resolution(ctx, width, height,
+                          dr->base_units_to_pixels * width / dr->base_width);
+
+    dr->level = level;
+    dr->over_budget_frames = 0;
+    dr->under_budget_frames = 0;
+}
+
+// NOTE: Lowers the internal resolution one level at a time while frames keep
+// going over budget and brings it back once there is headroom again. Only
+// called between frames, so a frame is rendered at a single resolution.
+static void
+update_dynamic_resolution(dynamic_resolution *dr, render_context *ctx, f64 frame_us) {
+    if (!dr->is_enabled) {
+        return;
+    }
+
+    if (frame_us > dr->budget_us) {
+        dr->over_budget_frames += 1;
+        dr->under_budget_frames = 0;
+    } else if (frame_us < DYNAMIC_RESOLUTION_HEADROOM * dr->budget_us) {
+        dr->under_budget_frames += 1;
+        dr->over_budget_frames = 0;
+    } else {
+        dr->over_budget_frames = 0;
+        dr->under_budget_frames = 0;
+    }
+
+    u32 level = dr->level;
+    if (dr->over_budget_frames >= DYNAMIC_RESOLUTION_LOWER_FRAMES &&
+        level + 1 < count(dynamic_resolution_levels))
+    {
+        level += 1;
+    } else if (dr->under_budget_frames >= DYNAMIC_RESOLUTION_RAISE_FRAMES && level > 0) {
+        level -= 1;
+    }
+
+    if (level != dr->level) {
+        set_dynamic_resolution_level(dr, ctx, level);
+        SDL_Log("Internal resolution %dx%d\n", ctx->width, ctx->height);
     }
 }
 
@@ -1,6 +1,17 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+typedef enum {
+    UPSCALE_FILTER_NEAREST,
+    UPSCALE_FILTER_BILINEAR,
+
+    UPSCALE_FILTER_COUNT,
+} upscale_filter;
+
+// NOTE: The game is rendered at an internal resolution which is upscaled to
+// the output resolution, the size of the texture shown in the window. The
+// internal buffers are allocated at max_width * max_height once, changing
+// the resolution only changes how much of them is used.
 typedef struct {
     SDL_Renderer *renderer;
     SDL_Texture *texture;
@@ -9,8 +20,67 @@ typedef struct {
     i32 width;
     i32 height;
     u32 pitch;
+    // NOTE: Rects and positions passed to the render functions are in world
+    // units, this maps them to pixels of the internal resolution
+    f32 units_to_pixels;
+
+    i32 max_width;
+    i32 max_height;
+
+    u32 *output_buf;
+    i32 output_width;
+    i32 output_height;
+    // NOTE: What ends up in the texture, the upscaled output_buf or buf
+    // itself when the two resolutions are the same
+    u32 *present_buf;
+
+    upscale_filter filter;
+    // NOTE: Per output column, the source column in 16.16 fixed point.
+    // Rebuilt whenever the resolution changes.
+    i32 *upscale_columns;
+    // NOTE: Per output column, the bilinear weights of the two source
+    // pixels, four 16-bit lanes each
+    u16 *upscale_weights;
+    // NOTE: One source row plus a padding pixel for the bilinear filter
+    u32 *upscale_row;
 } render_context;
 
+// NOTE: Fractions of the base internal resolution, from the full resolution
+// down to the lowest one dynamic resolution scaling goes to
+static const f32 dynamic_resolution_levels[] = { 1.0f, 0.85f, 0.7f, 0.5f };
+
+// NOTE: Consecutive frames over budget before the resolution is lowered and
+// under the headroom before it is raised. Raising is slow on purpose, so a
+// short quiet moment does not make the resolution go back and forth.
+#define DYNAMIC_RESOLUTION_LOWER_FRAMES 8
+#define DYNAMIC_RESOLUTION_RAISE_FRAMES 120
+// NOTE: The next level up has about 1.4x the pixels, only go there when
+// that still fits in the budget
+#define DYNAMIC_RESOLUTION_HEADROOM 0.6
+
+typedef struct {
+    i32 is_enabled;
+    f64 budget_us;
+
+    u32 level;
+    u32 over_budget_frames;
+    u32 under_budget_frames;
+
+    i32 base_width;
+    i32 base_height;
+    f32 base_units_to_pixels;
+} dynamic_resolution;
+
+static inline rect2
+rect_to_pixels(render_context *ctx, rect2 rect) {
+    rect2 result;
+
+    result.min = v2mul(ctx->units_to_pixels, rect.min);
+    result.max = v2mul(ctx->units_to_pixels, rect.max);
+
+    return result;
+}
+
 static inline vec4
 rgba(f32 r, f32 g, f32 b, f32 a) {
     vec4 result;
@@ -23,6 +93,65 @@ rgba(f32 r, f32 g, f32 b, f32 a) {
     return result;
 }
 
+enum {
+    // NOTE: Interpolate in linear space and convert the result to sRGB
+    SHADE_FLAG_GAMMA_CORRECT = (1 << 0),
+};
+
+// NOTE: Colors of the four corners of a shaded rect. A solid fill, a
+// linear gradient along either axis, a two-axis gradient and a solid color
+// plus a gradient are all special cases of it.
+typedef struct {
+    vec4 bottom_left;
+    vec4 bottom_right;
+    vec4 top_left;
+    vec4 top_right;
+    u32 flags;
+} shade;
+
+static inline shade
+shade_corners(vec4 bottom_left, vec4 bottom_right, vec4 top_left, vec4 top_right, u32 flags) {
+    shade result;
+
+    result.bottom_left = bottom_left;
+    result.bottom_right = bottom_right;
+    result.top_left = top_left;
+    result.top_right = top_right;
+    result.flags = flags;
+
+    return result;
+}
+
+static inline shade
+shade_solid(vec4 color, u32 flags) {
+    shade result = shade_corners(color, color, color, color, flags);
+    return result;
+}
+
+static inline shade
+shade_horizontal(vec4 left, vec4 right, u32 flags) {
+    shade result = shade_corners(left, right, left, right, flags);
+    return result;
+}
+
+static inline shade
+shade_vertical(vec4 bottom, vec4 top, u32 flags) {
+    shade result = shade_corners(bottom, bottom, top, top, flags);
+    return result;
+}
+
+// NOTE: Adds a solid color on top of every corner. The caller keeps the sum
+// of every channel within [0, 1].
+static inline shade
+add_shade_solid(shade s, vec4 color) {
+    shade result = shade_corners(v4add(s.bottom_left, color),
+                                 v4add(s.bottom_right, color),
+                                 v4add(s.top_left, color),
+                                 v4add(s.top_right, color),
+                                 s.flags);
+    return result;
+}
+
 #define RMASK 0xFF000000
 #define RSHIFT 24
 
@@ -56,6 +185,58 @@ rgba_to_u32(vec4 color) {
     return result;
 }
 
+static inline void
+rgba_to_u32_n_scalar(u32 *out, vec4 *colors, u32 n) {
+    for (u32 i = 0; i < n; ++i) {
+        out[i] = rgba_to_u32(colors[i]);
+    }
+}
+
+#if MATH_SSE2
+// NOTE: Reversed to (a, b, g, r) so that the packed bytes read as 0xRRGGBBAA
+// in a little endian u32
+static inline __m128i
+rgba_to_abgr_epi32(__m128 color, __m128 scale) {
+    __m128 c = _mm_mul_ps(color, scale);
+    __m128i result = _mm_cvttps_epi32(_mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 1, 2, 3)));
+    return result;
+}
+#endif
+
+// NOTE: The colors must be in [0, 1], like for rgba_to_u32
+static inline void
+rgba_to_u32_n(u32 *out, vec4 *colors, u32 n) {
+#if MATH_SSE2
+    __m128 scale = _mm_set1_ps(255.0f);
+
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i c0 = rgba_to_abgr_epi32(colors[i + 0].m, scale);
+        __m128i c1 = rgba_to_abgr_epi32(colors[i + 1].m, scale);
+        __m128i c2 = rgba_to_abgr_epi32(colors[i + 2].m, scale);
+        __m128i c3 = rgba_to_abgr_epi32(colors[i + 3].m, scale);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1),
+                                          _mm_packs_epi32(c2, c3));
+        _mm_storeu_si128((__m128i *)(out + i), packed);
+    }
+
+    rgba_to_u32_n_scalar(out + i, colors + i, n - i);
+#elif MATH_NEON
+    for (u32 i = 0; i < n; ++i) {
+        uint32x4_t c = vcvtq_u32_f32(vmulq_n_f32(colors[i].m, 255.0f));
+        // NOTE: (r, g, b, a) -> (a, b, g, r), see rgba_to_abgr_epi32
+        uint32x4_t rev = vrev64q_u32(c);
+        rev = vcombine_u32(vget_high_u32(rev), vget_low_u32(rev));
+        uint16x4_t c16 = vmovn_u32(rev);
+        uint8x8_t c8 = vmovn_u16(vcombine_u16(c16, c16));
+        vst1_lane_u32(out + i, vreinterpret_u32_u8(c8), 0);
+    }
+#else
+    rgba_to_u32_n_scalar(out, colors, n);
+#endif
+}
+
 static inline vec4
 u32_to_rgba(u32 color) {
     vec4 result = rgba(((color & RMASK) >> RSHIFT) / 255.0f,
@@ -74,7 +255,7 @@ getu32red(u32 color) {
 
 static inline u32
 setu32red(u32 color, u8 red) {
-    u32 result = ((color & ~RMASK)) | (red < RSHIFT);
+    u32 result = ((color & ~RMASK)) | ((u32)red << RSHIFT);
     return result;
 }
 
@@ -86,7 +267,7 @@ getu32green(u32 color) {
 
 static inline u32
 setu32green(u32 color, u8 green) {
-    u32 result = ((color & ~GMASK)) | (green < GSHIFT);
+    u32 result = ((color & ~GMASK)) | ((u32)green << GSHIFT);
     return result;
 }
 
@@ -98,7 +279,7 @@ getu32blue(u32 color) {
 
 static inline u32
 setu32blue(u32 color, u8 blue) {
-    u32 result = ((color & ~BMASK)) | (blue < BSHIFT);
+    u32 result = ((color & ~BMASK)) | ((u32)blue << BSHIFT);
     return result;
 }
 
@@ -110,7 +291,7 @@ getu32alpha(u32 color) {
 
 static inline u32
 setu32alpha(u32 color, u8 alpha) {
-    u32 result = ((color & ~AMASK)) | (alpha < ASHIFT);
+    u32 result = ((color & ~AMASK)) | ((u32)alpha << ASHIFT);
     return result;
 }
 
@@ -0,0 +1,346 @@
+static void
+init_rewind_buffer(rewind_buffer *rb, memory_arena *arena, u32 capacity, u32 state_size) {
+    *rb = (rewind_buffer) {};
+
+    rb->capacity = capacity;
+    rb->state_size = state_size;
+    // NOTE: The arena is touched up front, otherwise the page faults of the
+    // growing history would dominate the cost of a push
+    rb->data = push_buffer(arena, capacity);
+    rb->prev_state = push_buffer(arena, state_size);
+    rb->scratch = push_buffer(arena, get_rewind_scratch_size(state_size));
+}
+
+static void
+reset_rewind_buffer(rewind_buffer *rb, void *state) {
+    rb->head = 0;
+    rb->used = 0;
+    rb->first_record = 0;
+    rb->record_count = 0;
+    memcpy(rb->prev_state, state, rb->state_size);
+}
+
+// NOTE: The states are plain structs, so words are loaded through memcpy to
+// stay clear of alignment and aliasing issues
+static inline u64
+load_u64(u8 *p) {
+    u64 result;
+    memcpy(&result, p, sizeof(result));
+    return result;
+}
+
+// NOTE: Encodes the XOR of prev and cur into out and brings prev up to date,
+// only the changed words are written back.
+static u32
+encode_xor_delta(u8 *out, u8 *prev, u8 *cur, u32 size) {
+    u8 *at = out;
+
+    u32 word_count = size / sizeof(u64);
+
+    u32 word_index = 0;
+    while (word_index < word_count) {
+        u32 skip_begin = word_index;
+
+        // NOTE: Most of the state is unchanged between ticks, skip it four
+        // words at a time
+        while (word_index + 4 <= word_count &&
+               word_index - skip_begin + 4 < 0xFFFF)
+        {
+            u8 *p = prev + word_index * 8;
+            u8 *c = cur + word_index * 8;
+            u64 diff = (load_u64(p) ^ load_u64(c)) |
+                       (load_u64(p + 8) ^ load_u64(c + 8)) |
+                       (load_u64(p + 16) ^ load_u64(c + 16)) |
+                       (load_u64(p + 24) ^ load_u64(c + 24));
+            if (diff) {
+                break;
+            }
+            word_index += 4;
+        }
+
+        while (word_index < word_count &&
+               word_index - skip_begin < 0xFFFF &&
+               load_u64(prev + word_index * 8) == load_u64(cur + word_index * 8))
+        {
+            ++word_index;
+        }
+
+        u32 literal_begin = word_index;
+        while (word_index < word_count &&
+               word_index - literal_begin < 0xFFFF &&
+               load_u64(prev + word_index * 8) != load_u64(cur + word_index * 8))
+        {
+            ++word_index;
+        }
+
+        u16 skip_word_count = literal_begin - skip_begin;
+        u16 literal_word_count = word_index - literal_begin;
+
+        memcpy(at, &skip_word_count, sizeof(u16));
+        at += sizeof(u16);
+        memcpy(at, &literal_word_count, sizeof(u16));
+        at += sizeof(u16);
+
+        for (u32 i = literal_begin; i < word_index; ++i) {
+            u64 delta = load_u64(prev + i * 8) ^ load_u64(cur + i * 8);
+            memcpy(at, &delta, sizeof(u64));
+            at += sizeof(u64);
+            memcpy(prev + i * 8, cur + i * 8, sizeof(u64));
+        }
+    }
+
+    for (u32 i = word_count * sizeof(u64); i < size; ++i) {
+        *at++ = prev[i] ^ cur[i];
+        prev[i] = cur[i];
+    }
+
+    u32 result = at - out;
+    return result;
+}
+
+// NOTE: Returns the number of delta bytes consumed
+static u32
+apply_xor_delta(u8 *state, u8 *delta, u32 size) {
+    u8 *at = delta;
+
+    u32 word_count = size / sizeof(u64);
+
+    u32 word_index = 0;
+    while (word_index < word_count) {
+        u16 skip_word_count;
+        u16 literal_word_count;
+
+        memcpy(&skip_word_count, at, sizeof(u16));
+        at += sizeof(u16);
+        memcpy(&literal_word_count, at, sizeof(u16));
+        at += sizeof(u16);
+
+        word_index += skip_word_count;
+        for (u32 i = 0; i < literal_word_count; ++i) {
+            u64 word = load_u64(state + word_index * 8) ^ load_u64(at);
+            memcpy(state + word_index * 8, &word, sizeof(u64));
+            at += sizeof(u64);
+            word_index += 1;
+        }
+    }
+
+    for (u32 i = word_count * sizeof(u64); i < size; ++i) {
+        state[i] ^= *at++;
+    }
+
+    u32 result = at - delta;
+    return result;
+}
+
+static void
+drop_oldest_rewind_record(rewind_buffer *rb) {
+    assert(rb->record_count > 0);
+
+    rb->used -= rb->record_sizes[rb->first_record];
+    rb->first_record = (rb->first_record + 1) % REWIND_MAX_RECORD_COUNT;
+    rb->record_count -= 1;
+}
+
+// NOTE: Records a new tick. The cost is one compare pass over the live ranges
+// plus a copy of the changed words.
+static void
+push_rewind_state(rewind_buffer *rb, void *state, state_range *ranges, u32 range_count) {
+    assert(range_count <= MAX_STATE_RANGE_COUNT);
+
+    u8 *at = rb->scratch;
+    memcpy(at, &range_count, sizeof(u32));
+    at += sizeof(u32);
+
+    for (u32 i = 0; i < range_count; ++i) {
+        state_range *range = ranges + i;
+        assert(range->offset + range->size <= rb->state_size);
+
+        memcpy(at, range, sizeof(state_range));
+        at += sizeof(state_range);
+        at += encode_xor_delta(at, rb->prev_state + range->offset,
+                               (u8 *)state + range->offset, range->size);
+    }
+
+    u32 size = at - rb->scratch;
+
+    if (size > rb->capacity) {
+        logerr("Rewind record of %u bytes exceeds the buffer capacity\n", size);
+        rb->record_count = 0;
+        rb->first_record = 0;
+        rb->used = 0;
+        return;
+    }
+
+    while (rb->record_count == REWIND_MAX_RECORD_COUNT ||
+           rb->used + size > rb->capacity)
+    {
+        drop_oldest_rewind_record(rb);
+    }
+
+    u32 record = (rb->first_record + rb->record_count) % REWIND_MAX_RECORD_COUNT;
+    rb->record_offsets[record] = rb->head;
+    rb->record_sizes[record] = size;
+    rb->record_count += 1;
+    rb->used += size;
+
+    u32 first_part = rb->capacity - rb->head;
+    if (first_part > size) {
+        first_part = size;
+    }
+    memcpy(rb->data + rb->head, rb->scratch, first_part);
+    memcpy(rb->data, rb->scratch + first_part, size - first_part);
+
+    rb->head = (rb->head + size) % rb->capacity;
+}
+
+// NOTE: Moves one tick back in time and copies that state out. The records
+// are applied to the last pushed state, not to the caller's, which may have
+// been changed since. The whole state is copied out because the live ranges
+// of the older state are not known here. Returns 0 when the history is
+// exhausted.
+static int
+pop_rewind_state(rewind_buffer *rb, void *state) {
+    if (rb->record_count == 0) {
+        return 0;
+    }
+
+    rb->record_count -= 1;
+    u32 record = (rb->first_record + rb->record_count) % REWIND_MAX_RECORD_COUNT;
+    u32 offset = rb->record_offsets[record];
+    u32 size = rb->record_sizes[record];
+
+    u32 first_part = rb->capacity - offset;
+    if (first_part > size) {
+        first_part = size;
+    }
+    memcpy(rb->scratch, rb->data + offset, first_part);
+    memcpy(rb->scratch + first_part, rb->data, size - first_part);
+
+    rb->head = offset;
+    rb->used -= size;
+
+    u8 *at = rb->scratch;
+    u32 range_count;
+    memcpy(&range_count, at, sizeof(u32));
+    at += sizeof(u32);
+
+    for (u32 i = 0; i < range_count; ++i) {
+        state_range range;
+        memcpy(&range, at, sizeof(state_range));
+        at += sizeof(state_range);
+        at += apply_xor_delta(rb->prev_state + range.offset, at, range.size);
+    }
+
+    memcpy(state, rb->prev_state, rb->state_size);
+
+    return 1;
+}
+
+// NOTE: Maps the checkpoint file at path, creating it if needed. Returns 1 if
+// the file already holds a compatible state which can be resumed from.
+static int
+open_checkpoint(checkpoint_file *cp, const char *path, u32 state_size, u32 layout_hash) {
+    *cp = (checkpoint_file) {};
+    cp->fd = -1;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logerr("Failed to open checkpoint %s\n", path);
+        return 0;
+    }
+
+    u32 slot_stride = (sizeof(checkpoint_slot) + state_size + 7) & ~7u;
+    u32 size = sizeof(checkpoint_header) + CHECKPOINT_SLOT_COUNT * slot_stride;
+
+    struct stat st;
+    int has_state = fstat(fd, &st) == 0 && st.st_size == size;
+
+    if (!has_state && ftruncate(fd, size) != 0) {
+        logerr("Failed to resize checkpoint %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    void *base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        logerr("Failed to map checkpoint %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    cp->fd = fd;
+    cp->base = base;
+    cp->size = size;
+    cp->state_size = state_size;
+    cp->slot_stride = slot_stride;
+
+    checkpoint_header *header = (checkpoint_header *)cp->base;
+    if (has_state) {
+        has_state = header->magic == CHECKPOINT_MAGIC &&
+                    header->version == CHECKPOINT_VERSION &&
+                    header->state_size == state_size &&
+                    header->layout_hash == layout_hash;
+    }
+
+    if (has_state) {
+        // NOTE: Only resume from a state that has been completely written,
+        // the newest one if both slots hold one
+        for (u32 i = 0; i < CHECKPOINT_SLOT_COUNT; ++i) {
+            checkpoint_slot *slot = get_checkpoint_slot(cp, i);
+            if (slot->sequence > cp->sequence &&
+                slot->sequence % CHECKPOINT_SLOT_COUNT == i)
+            {
+                cp->sequence = slot->sequence;
+            }
+        }
+    } else {
+        memset(cp->base, 0, size);
+        header->magic = CHECKPOINT_MAGIC;
+        header->version = CHECKPOINT_VERSION;
+        header->state_size = state_size;
+        header->layout_hash = layout_hash;
+    }
+
+    return cp->sequence != 0;
+}
+
+// NOTE: The write goes straight into the page cache, the kernel flushes it
+// to disk in the background. The older slot is overwritten, it is marked
+// empty first and only gets its sequence number once the state is complete.
+// Only the live ranges are copied, the rest of the slot keeps stale bytes.
+static void
+save_checkpoint(checkpoint_file *cp, void *state, state_range *ranges, u32 range_count) {
+    if (!cp->base) {
+        return;
+    }
+
+    u64 sequence = cp->sequence + 1;
+    checkpoint_slot *slot = get_checkpoint_slot(cp, sequence);
+
+    slot->sequence = 0;
+    atomic_signal_fence(memory_order_seq_cst);
+    for (u32 i = 0; i < range_count; ++i) {
+        state_range *range = ranges + i;
+        assert(range->offset + range->size <= cp->state_size);
+        memcpy((u8 *)(slot + 1) + range->offset, (u8 *)state + range->offset, range->size);
+    }
+    atomic_signal_fence(memory_order_seq_cst);
+    slot->sequence = sequence;
+
+    cp->sequence = sequence;
+}
+
+static void
+close_checkpoint(checkpoint_file *cp) {
+    if (cp->base) {
+        msync(cp->base, cp->size, MS_SYNC);
+        munmap(cp->base, cp->size);
+    }
+
+    if (cp->fd >= 0) {
+        close(cp->fd);
+    }
+
+    *cp = (checkpoint_file) {};
+    cp->fd = -1;
+}
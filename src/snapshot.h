@@ -0,0 +1,102 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#define REWIND_MAX_RECORD_COUNT 4096
+#define MAX_STATE_RANGE_COUNT 4
+
+// NOTE: A byte range of the state that holds live data. Snapshots only cover
+// the ranges they are given, the bytes outside of them are left untouched, so
+// the ranges must not overlap and must cover everything that is read later.
+typedef struct {
+    u32 offset;
+    u32 size;
+} state_range;
+
+// NOTE: The rewind buffer stores one record per tick. Every record is the
+// XOR of two consecutive states over the live ranges of the newer one, each
+// range run-length encoded on 8 byte words:
+//
+//   u32 range_count
+//   (state_range range,
+//    (u16 skip_word_count, u16 literal_word_count, u64 literal_words[])*
+//    u8 tail_bytes[range.size % 8])[range_count]
+//
+// Because XOR is its own inverse the newest state can be walked backwards
+// one record at a time, so no keyframes are needed and the oldest records
+// can be dropped whenever the byte budget is exhausted.
+typedef struct {
+    u8 *data;
+    u32 capacity;
+    u32 head;
+    u32 used;
+
+    u32 first_record;
+    u32 record_count;
+    u32 record_offsets[REWIND_MAX_RECORD_COUNT];
+    u32 record_sizes[REWIND_MAX_RECORD_COUNT];
+
+    u32 state_size;
+    // NOTE: The last state that was pushed
+    u8 *prev_state;
+    // NOTE: Large enough to hold the worst case encoding of one state
+    u8 *scratch;
+} rewind_buffer;
+
+#define CHECKPOINT_MAGIC 0x4B4F5242 // "BROK"
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_SLOT_COUNT 2
+
+// NOTE: A checkpoint file is this header followed by two slots, each a
+// checkpoint_slot and the state. Saves alternate between the slots, so a
+// save that is cut short never touches the newest complete state.
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 state_size;
+    // NOTE: Of the offsets and sizes of the state fields, a state with the
+    // same size but a different layout is not resumed from
+    u32 layout_hash;
+} checkpoint_header;
+
+typedef struct {
+    // NOTE: Counts up with every save, written after the state. Zero while
+    // the slot is being written or before it was ever written.
+    u64 sequence;
+} checkpoint_slot;
+
+typedef struct {
+    int fd;
+    u8 *base;
+    u32 size;
+    u32 state_size;
+    u32 slot_stride;
+    // NOTE: Of the newest complete state, 0 if there is none
+    u64 sequence;
+} checkpoint_file;
+
+static inline u32
+get_rewind_scratch_size(u32 state_size) {
+    // NOTE: The worst case is a literal word followed by a skipped word for
+    // the whole state, which needs a 4 byte run header per 16 bytes, plus the
+    // range headers, the last run header and the tail bytes of every range.
+    u32 result = state_size + state_size / 4 + sizeof(u32) +
+                 MAX_STATE_RANGE_COUNT * (sizeof(state_range) + 16);
+    return result;
+}
+
+static inline checkpoint_slot *
+get_checkpoint_slot(checkpoint_file *cp, u64 sequence) {
+    u32 index = sequence % CHECKPOINT_SLOT_COUNT;
+    checkpoint_slot *result = (checkpoint_slot *)(cp->base + sizeof(checkpoint_header) +
+                                                  index * cp->slot_stride);
+    return result;
+}
+
+// NOTE: The newest complete state
+static inline void *
+get_checkpoint_state(checkpoint_file *cp) {
+    void *result = get_checkpoint_slot(cp, cp->sequence) + 1;
+    return result;
+}
+
+#endif
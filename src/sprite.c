@@ -0,0 +1,153 @@
+static void
+init_sprite_atlas(sprite_atlas *atlas, memory_arena *arena) {
+    *atlas = (sprite_atlas) {};
+
+    atlas->width = SPRITE_ATLAS_SIZE;
+    atlas->height = SPRITE_ATLAS_SIZE;
+    atlas->pixels = push_array(arena, atlas->width * atlas->height, u32);
+}
+
+static int
+allocate_atlas_region(sprite_atlas *atlas, i32 width, i32 height, sprite *result) {
+    if (atlas->shelf_x + width > atlas->width) {
+        atlas->shelf_x = 0;
+        atlas->shelf_y += atlas->shelf_height + SPRITE_ATLAS_PADDING;
+        atlas->shelf_height = 0;
+    }
+
+    if (width > atlas->width || atlas->shelf_y + height > atlas->height) {
+        return 0;
+    }
+
+    result->x = atlas->shelf_x;
+    result->y = atlas->shelf_y;
+    result->width = width;
+    result->height = height;
+
+    atlas->shelf_x += width + SPRITE_ATLAS_PADDING;
+    if (height > atlas->shelf_height) {
+        atlas->shelf_height = height;
+    }
+
+    return 1;
+}
+
+// NOTE: Loads a BMP into the atlas. The conversion to the framebuffer layout
+// and the premultiplication are done here once, so blits only blend.
+static int
+load_sprite(sprite_atlas *atlas, const char *path, sprite *result) {
+    *result = (sprite) {};
+
+    SDL_Surface *loaded = SDL_LoadBMP(path);
+    if (!loaded) {
+        logerr("Failed to load %s: %s\n", path, SDL_GetError());
+        return 0;
+    }
+
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) {
+        logerr("Failed to convert %s: %s\n", path, SDL_GetError());
+        return 0;
+    }
+
+    sprite s;
+    if (!allocate_atlas_region(atlas, surface->w, surface->h, &s)) {
+        logerr("Sprite atlas is full, can't fit %s\n", path);
+        SDL_FreeSurface(surface);
+        return 0;
+    }
+
+    for (i32 y = 0; y < s.height; ++y) {
+        u32 *src = (u32 *)((u8 *)surface->pixels + y * surface->pitch);
+        u32 *dst = get_sprite_row(atlas, &s, y);
+        for (i32 x = 0; x < s.width; ++x) {
+            *dst++ = premultiply_u32(*src++);
+        }
+    }
+
+    SDL_FreeSurface(surface);
+
+    *result = s;
+    return 1;
+}
+
+#define SPRITE_BLIT_CHUNK_SIZE 256
+
+// NOTE: Blends the sprite stretched over rect, in world units. A pixel is
+// covered when its center is inside the rect, and it is sampled from the
+// sprite pixel under that center, so the sprite matches the size of the
+// rect at every resolution, also when it is drawn smaller than it is.
+static void
+render_sprite(render_context *ctx, sprite_atlas *atlas, sprite *s, rect2 rect) {
+    if (!is_sprite_loaded(s)) {
+        return;
+    }
+
+    rect.min = v2mul(ctx->units_to_pixels, rect.min);
+    rect.max = v2mul(ctx->units_to_pixels, rect.max);
+
+    i32 rminx = (i32)floorf(rect.min.x + 0.5f);
+    i32 rminy = (i32)floorf(rect.min.y + 0.5f);
+    i32 rmaxx = (i32)floorf(rect.max.x + 0.5f);
+    i32 rmaxy = (i32)floorf(rect.max.y + 0.5f);
+
+    i32 minx = rminx;
+    i32 miny = rminy;
+    i32 maxx = rmaxx;
+    i32 maxy = rmaxy;
+
+    if (minx < 0) { minx = 0; }
+    if (maxx >= ctx->width) { maxx = ctx->width; }
+    if (miny < 0) { miny = 0; }
+    if (maxy >= ctx->height) { maxy = ctx->height; }
+
+    if (minx >= maxx || miny >= maxy) {
+        return;
+    }
+
+    // NOTE: The sprite pixel of destination pixel i is (2 * i + 1) * size /
+    // (2 * dst_size), the x one is stepped along a row without a division
+    i32 dst_width = rmaxx - rminx;
+    i32 dst_height = rmaxy - rminy;
+    i32 den = 2 * dst_width;
+
+    // NOTE: Both the framebuffer and the atlas are walked from the top row
+    // down in memory, the framebuffer is stored bottom-up.
+    u32 *row = ctx->buf + (ctx->height - 1 - (maxy - 1)) * ctx->width + minx;
+    for (i32 y = maxy - 1; y >= miny; --y) {
+        // NOTE: Sprite rows count from the top
+        i32 src_row = (2 * (rmaxy - 1 - y) + 1) * s->height / (2 * dst_height);
+        u32 *src = get_sprite_row(atlas, s, src_row);
+
+        if (dst_width == s->width) {
+            blend_premultiplied_span(row, src + (minx - rminx), 1, maxx - minx, BLEND_MODE_OVER);
+        } else {
+            u32 chunk[SPRITE_BLIT_CHUNK_SIZE];
+
+            i32 num = (2 * (minx - rminx) + 1) * s->width;
+            i32 src_x = num / den;
+            i32 rem = num % den;
+
+            for (i32 x = minx; x < maxx; x += SPRITE_BLIT_CHUNK_SIZE) {
+                i32 chunk_count = maxx - x;
+                if (chunk_count > SPRITE_BLIT_CHUNK_SIZE) {
+                    chunk_count = SPRITE_BLIT_CHUNK_SIZE;
+                }
+
+                for (i32 i = 0; i < chunk_count; ++i) {
+                    chunk[i] = src[src_x];
+                    rem += 2 * s->width;
+                    while (rem >= den) {
+                        rem -= den;
+                        src_x += 1;
+                    }
+                }
+
+                blend_premultiplied_span(row + (x - minx), chunk, 1, chunk_count, BLEND_MODE_OVER);
+            }
+        }
+
+        row += ctx->width;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#define SPRITE_ATLAS_SIZE 1024
+#define SPRITE_ATLAS_PADDING 1
+
+// NOTE: All sprites live in one atlas. The pixels are stored top row first,
+// like SDL surfaces, and already converted to the framebuffer's 0xRRGGBBAA
+// layout and premultiplied, see premultiply_u32.
+typedef struct {
+    u32 *pixels;
+    i32 width;
+    i32 height;
+
+    // NOTE: Sprites are packed in shelves from the top left corner
+    i32 shelf_x;
+    i32 shelf_y;
+    i32 shelf_height;
+} sprite_atlas;
+
+// NOTE: A region of the atlas, a sprite with zero size is not loaded
+typedef struct {
+    i32 x;
+    i32 y;
+    i32 width;
+    i32 height;
+} sprite;
+
+static inline i32
+is_sprite_loaded(sprite *s) {
+    i32 result = s->width > 0 && s->height > 0;
+    return result;
+}
+
+static inline u32 *
+get_sprite_row(sprite_atlas *atlas, sprite *s, i32 row) {
+    u32 *result = atlas->pixels + (s->y + row) * atlas->width + s->x;
+    return result;
+}
+
+#endif
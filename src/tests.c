@@ -0,0 +1,681 @@
+// NOTE: Checks the SIMD batch functions against their scalar versions, which
+// are exactly what a MATH_NO_SIMD build runs, then times both. test.sh builds
+// and runs it once with and once without a SIMD backend. Also round trips
+// frames through the capture encoding and game states through the rewind
+// buffer and the checkpoint, and blits sprites. Exits with 1 if any check
+// fails.
+#define BREAKOUT_NO_MAIN
+#include "breakout.c"
+
+#define CHECK_ROUND_COUNT 200
+#define CHECK_MAX_COUNT 67
+#define CHECK_FRAME_MAX_PIXEL_COUNT 64
+#define BENCH_COUNT 1024
+#define BENCH_RUN_COUNT 2000
+#define CHECK_TICK_COUNT 240
+#define CHECK_SPRITE_MAX_SIZE 40
+#define CHECK_TARGET_WIDTH 64
+#define CHECK_TARGET_HEIGHT 48
+#define CHECK_OUTPUT_MAX_WIDTH 96
+#define CHECK_OUTPUT_MAX_HEIGHT 40
+#define BENCH_TICK_COUNT 2000
+#define TEST_CHECKPOINT_PATH "tests.checkpoint"
+
+static u32 failed_check_count;
+
+#define check(expr, n) \
+    do { \
+        if (!(expr)) { \
+            logerr("%s:%d: %s failed for n = %u\n", __FILE__, __LINE__, #expr, (u32)(n)); \
+            failed_check_count += 1; \
+        } \
+    } while (0)
+
+static u32
+next_random(u32 *seed) {
+    *seed = *seed * 1664525 + 1013904223;
+    u32 result = *seed >> 8;
+    return result;
+}
+
+static f32
+next_random_f32(u32 *seed, f32 min, f32 max) {
+    f32 result = min + (max - min) * (next_random(seed) / 16777216.0f);
+    return result;
+}
+
+// NOTE: On a coarse grid, so that rects often share an edge exactly and the
+// strict compares of the overlap test are exercised
+static f32
+next_random_grid_f32(u32 *seed, f32 min, f32 max) {
+    f32 result = min + 5.0f * (next_random(seed) % (u32)((max - min) / 5.0f));
+    return result;
+}
+
+static u32
+next_random_color(u32 *seed) {
+    u32 result = (next_random(seed) << 8) ^ next_random(seed);
+
+    // NOTE: Fully transparent and opaque pixels take their own paths
+    u32 alpha = next_random(seed) % 4;
+    if (alpha == 0) {
+        result &= 0xFFFFFF00;
+    } else if (alpha == 1) {
+        result |= 0xFF;
+    }
+    return result;
+}
+
+static void
+fill_random_inputs(u32 *seed, vec2 *a, vec2 *b, vec4 *colors, u32 n) {
+    for (u32 i = 0; i < n; ++i) {
+        a[i] = v2(next_random_grid_f32(seed, 0.0f, 800.0f), next_random_grid_f32(seed, 0.0f, 600.0f));
+        b[i] = v2(next_random_grid_f32(seed, 0.0f, 120.0f), next_random_grid_f32(seed, 0.0f, 120.0f));
+        colors[i] = rgba(next_random_f32(seed, 0.0f, 1.0f), next_random_f32(seed, 0.0f, 1.0f),
+                         next_random_f32(seed, 0.0f, 1.0f), next_random_f32(seed, 0.0f, 1.0f));
+    }
+
+    if (n >= 2) {
+        colors[0] = rgba(0.0f, 0.0f, 0.0f, 0.0f);
+        colors[1] = rgba(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+}
+
+// NOTE: Every count up to CHECK_MAX_COUNT, so every tail length of every
+// batch loop is covered, with fresh inputs each round
+static void
+check_batch_functions() {
+    u32 seed = 1;
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT; ++round) {
+        for (u32 n = 0; n <= CHECK_MAX_COUNT; ++n) {
+            vec2 a[CHECK_MAX_COUNT], b[CHECK_MAX_COUNT];
+            vec4 colors[CHECK_MAX_COUNT];
+            fill_random_inputs(&seed, a, b, colors, n);
+
+            f32 s = next_random_f32(&seed, -1.0f, 1.0f);
+            {
+                vec2 expected[CHECK_MAX_COUNT], actual[CHECK_MAX_COUNT];
+                v2madd_n_scalar(expected, a, s, b, n);
+                v2madd_n(actual, a, s, b, n);
+                check(memcmp(expected, actual, n * sizeof(vec2)) == 0, n);
+            }
+
+            rect2 rects[CHECK_MAX_COUNT];
+            {
+                rect2 expected[CHECK_MAX_COUNT];
+                rect2censize_n_scalar(expected, a, b, n);
+                rect2censize_n(rects, a, b, n);
+                check(memcmp(expected, rects, n * sizeof(rect2)) == 0, n);
+            }
+
+            {
+                u8 expected[CHECK_MAX_COUNT], actual[CHECK_MAX_COUNT];
+                rect2 test = rect2censize(v2(next_random_grid_f32(&seed, 0.0f, 800.0f),
+                                             next_random_grid_f32(&seed, 0.0f, 600.0f)),
+                                          v2(next_random_grid_f32(&seed, 0.0f, 400.0f),
+                                             next_random_grid_f32(&seed, 0.0f, 300.0f)));
+                test_rect2_overlap_n_scalar(expected, test, rects, n);
+                test_rect2_overlap_n(actual, test, rects, n);
+                check(memcmp(expected, actual, n) == 0, n);
+            }
+
+            {
+                u32 expected[CHECK_MAX_COUNT], actual[CHECK_MAX_COUNT];
+                rgba_to_u32_n_scalar(expected, colors, n);
+                rgba_to_u32_n(actual, colors, n);
+                check(memcmp(expected, actual, n * sizeof(u32)) == 0, n);
+            }
+        }
+    }
+}
+
+// NOTE: The blend kernel against its scalar reference, on random pairs of
+// pixels with fully transparent and opaque sources mixed in, at every count
+// up to CHECK_MAX_COUNT and with a single source pixel too
+static void
+check_blend_functions() {
+    u32 seed = 6;
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT; ++round) {
+        for (u32 n = 0; n <= CHECK_MAX_COUNT; ++n) {
+            u32 src[CHECK_MAX_COUNT], dst[CHECK_MAX_COUNT];
+            for (u32 i = 0; i < n; ++i) {
+                src[i] = next_random_color(&seed);
+                if (round % 2) {
+                    src[i] = premultiply_u32(src[i]);
+                }
+                dst[i] = next_random_color(&seed);
+            }
+
+            for (blend_mode mode = BLEND_MODE_OVER; mode <= BLEND_MODE_ADD; ++mode) {
+                for (i32 src_step = 0; src_step <= 1; ++src_step) {
+                    u32 expected[CHECK_MAX_COUNT], actual[CHECK_MAX_COUNT];
+                    memcpy(actual, dst, n * sizeof(u32));
+                    for (u32 i = 0; i < n; ++i) {
+                        expected[i] = blend_premultiplied_pixel(dst[i], src[i * src_step], mode);
+                    }
+
+                    blend_premultiplied_span(actual, src, src_step, n, mode);
+                    check(memcmp(expected, actual, n * sizeof(u32)) == 0, n);
+                }
+            }
+        }
+    }
+}
+
+// NOTE: Samples and the mix buffer are drawn from the full range, so the
+// saturation is hit, the volume from the range play_sound produces
+static void
+check_mix_samples() {
+    u32 seed = 7;
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT; ++round) {
+        for (u32 n = 0; n <= CHECK_MAX_COUNT; ++n) {
+            i16 samples[CHECK_MAX_COUNT], expected[CHECK_MAX_COUNT], actual[CHECK_MAX_COUNT];
+            for (u32 i = 0; i < n; ++i) {
+                samples[i] = (i16)next_random(&seed);
+                expected[i] = (i16)next_random(&seed);
+            }
+            memcpy(actual, expected, n * sizeof(i16));
+
+            i16 volume = (i16)(next_random(&seed) % 32768);
+            if (round == 0) {
+                volume = 32767;
+            }
+
+            mix_samples_scalar(expected, samples, n, volume);
+            mix_samples(actual, samples, n, volume);
+            check(memcmp(expected, actual, n * sizeof(i16)) == 0, n);
+        }
+    }
+}
+
+// NOTE: The vec4 operations have no separate scalar version, they are
+// checked against the plain per-component math
+static void
+check_vec4_functions() {
+    u32 seed = 2;
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT; ++round) {
+        vec4 l = v4(next_random_f32(&seed, -10.0f, 10.0f), next_random_f32(&seed, -10.0f, 10.0f),
+                    next_random_f32(&seed, -10.0f, 10.0f), next_random_f32(&seed, -10.0f, 10.0f));
+        vec4 r = v4(next_random_f32(&seed, -10.0f, 10.0f), next_random_f32(&seed, -10.0f, 10.0f),
+                    next_random_f32(&seed, -10.0f, 10.0f), next_random_f32(&seed, -10.0f, 10.0f));
+        f32 s = next_random_f32(&seed, -10.0f, 10.0f);
+
+        vec4 sum = v4add(l, r);
+        vec4 difference = v4sub(l, r);
+        vec4 product = v4mul(s, r);
+
+        check(sum.x == l.x + r.x && sum.y == l.y + r.y &&
+              sum.z == l.z + r.z && sum.w == l.w + r.w, 1);
+        check(difference.x == l.x - r.x && difference.y == l.y - r.y &&
+              difference.z == l.z - r.z && difference.w == l.w - r.w, 1);
+        check(product.x == s * r.x && product.y == s * r.y &&
+              product.z == s * r.z && product.w == s * r.w, 1);
+    }
+}
+
+// NOTE: Writes single row frames with the capture writer and reads them back
+// like a replay does. Few distinct colors, so runs of every length come up.
+static void
+check_capture_encoding() {
+    u32 seed = 4;
+
+    u32 pixels[CHECK_FRAME_MAX_PIXEL_COUNT];
+    u32 decoded[CHECK_FRAME_MAX_PIXEL_COUNT];
+    u8 encoded[CHECK_FRAME_MAX_PIXEL_COUNT * sizeof(u32)];
+    u8 scratch[CHECK_FRAME_MAX_PIXEL_COUNT * sizeof(u32)];
+
+    // NOTE: Encodes to exactly the raw size, which has to be stored raw
+    u32 same_size[] = { 1, 2, 3, 4, 5, 9, 9, 9 };
+    check(encode_capture_rle(encoded, sizeof(same_size), same_size, count(same_size)) == 0,
+          count(same_size));
+
+    FILE *file = tmpfile();
+    if (!file) {
+        logerr("Failed to create a temporary file\n");
+        failed_check_count += 1;
+        return;
+    }
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT; ++round) {
+        for (u32 n = 1; n <= CHECK_FRAME_MAX_PIXEL_COUNT; ++n) {
+            if (round == 0 && n == count(same_size)) {
+                memcpy(pixels, same_size, sizeof(same_size));
+            } else {
+                u32 color_count = round % 2 ? 1 + round % 5 : 0xFFFFFFFF;
+                for (u32 i = 0; i < n; ++i) {
+                    pixels[i] = next_random(&seed) % color_count;
+                }
+            }
+
+            capture_state cs = {};
+            cs.width = n;
+            cs.height = 1;
+            cs.encoded = encoded;
+            cs.out = file;
+
+            capture_entry entry = {};
+            entry.frame_index = round;
+
+            rewind(file);
+            write_capture_frame(&cs, &entry, pixels, hash_pixels(pixels, n));
+            rewind(file);
+
+            capture_frame_header header;
+            check(fread(&header, sizeof(header), 1, file) == 1 &&
+                  read_capture_pixels(file, &header, decoded, scratch, n) &&
+                  memcmp(pixels, decoded, n * sizeof(u32)) == 0, n);
+        }
+    }
+
+    fclose(file);
+}
+
+// NOTE: Blits random sprites over random rects, scaled up and down and often
+// partly or fully off the target, and compares every pixel of the target
+// with the sprite pixel under its center blended over the old one
+static void
+check_render_sprite(game_memory *memory) {
+    u32 seed = 5;
+
+    sprite_atlas atlas;
+    init_sprite_atlas(&atlas, &memory->permanent);
+
+    static u32 target[CHECK_TARGET_WIDTH * CHECK_TARGET_HEIGHT];
+    static u32 expected[CHECK_TARGET_WIDTH * CHECK_TARGET_HEIGHT];
+
+    render_context ctx = {};
+    ctx.buf = target;
+    ctx.width = CHECK_TARGET_WIDTH;
+    ctx.height = CHECK_TARGET_HEIGHT;
+    ctx.pitch = CHECK_TARGET_WIDTH * 4;
+    ctx.units_to_pixels = 1.0f;
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT * 4; ++round) {
+        sprite s = {};
+        s.width = 1 + next_random(&seed) % CHECK_SPRITE_MAX_SIZE;
+        s.height = 1 + next_random(&seed) % CHECK_SPRITE_MAX_SIZE;
+        for (i32 y = 0; y < s.height; ++y) {
+            u32 *src = get_sprite_row(&atlas, &s, y);
+            for (i32 x = 0; x < s.width; ++x) {
+                src[x] = premultiply_u32(next_random_color(&seed));
+            }
+        }
+
+        // NOTE: Every other round at the sprite's own size, the plain blit
+        vec2 size = v2((f32)s.width, (f32)s.height);
+        if (round % 2) {
+            size = v2(next_random_f32(&seed, 0.0f, 2.0f * CHECK_SPRITE_MAX_SIZE),
+                      next_random_f32(&seed, 0.0f, 2.0f * CHECK_SPRITE_MAX_SIZE));
+        }
+        vec2 min = v2(next_random_f32(&seed, -size.x - 4.0f, CHECK_TARGET_WIDTH + 4.0f),
+                      next_random_f32(&seed, -size.y - 4.0f, CHECK_TARGET_HEIGHT + 4.0f));
+        rect2 rect = rect2minsize(min, size);
+
+        for (u32 i = 0; i < count(target); ++i) {
+            target[i] = next_random_color(&seed);
+        }
+        memcpy(expected, target, sizeof(target));
+
+        i32 rminx = (i32)floorf(rect.min.x + 0.5f);
+        i32 rminy = (i32)floorf(rect.min.y + 0.5f);
+        i32 rmaxx = (i32)floorf(rect.max.x + 0.5f);
+        i32 rmaxy = (i32)floorf(rect.max.y + 0.5f);
+
+        for (i32 y = 0; y < CHECK_TARGET_HEIGHT; ++y) {
+            for (i32 x = 0; x < CHECK_TARGET_WIDTH; ++x) {
+                if (x >= rminx && x < rmaxx && y >= rminy && y < rmaxy) {
+                    i32 src_x = (2 * (x - rminx) + 1) * s.width / (2 * (rmaxx - rminx));
+                    i32 src_y = (2 * (rmaxy - 1 - y) + 1) * s.height / (2 * (rmaxy - rminy));
+                    u32 src = get_sprite_row(&atlas, &s, src_y)[src_x];
+                    u32 *pixel = expected + (CHECK_TARGET_HEIGHT - 1 - y) * CHECK_TARGET_WIDTH + x;
+                    *pixel = blend_premultiplied_pixel(*pixel, src, BLEND_MODE_OVER);
+                }
+            }
+        }
+
+        render_sprite(&ctx, &atlas, &s, rect);
+        check(memcmp(expected, target, sizeof(target)) == 0, round);
+    }
+}
+
+// NOTE: Both filters against a per-pixel reference, at output widths that
+// leave every tail length of the SIMD loops and with sources down to a
+// single pixel, so the clamped first and last rows and columns are hit
+static void
+check_upscale(game_memory *memory) {
+    u32 seed = 8;
+
+    render_context ctx;
+    init_render_context(&ctx, &memory->permanent, 0, 0,
+                        CHECK_OUTPUT_MAX_WIDTH, CHECK_OUTPUT_MAX_HEIGHT,
+                        CHECK_OUTPUT_MAX_WIDTH, CHECK_OUTPUT_MAX_HEIGHT);
+
+    static u32 expected[CHECK_OUTPUT_MAX_WIDTH * CHECK_OUTPUT_MAX_HEIGHT];
+    static u32 row[CHECK_OUTPUT_MAX_WIDTH + 1];
+
+    for (u32 round = 0; round < CHECK_ROUND_COUNT * 2; ++round) {
+        ctx.output_width = 1 + next_random(&seed) % CHECK_OUTPUT_MAX_WIDTH;
+        ctx.output_height = 1 + next_random(&seed) % CHECK_OUTPUT_MAX_HEIGHT;
+        ctx.filter = round % 2 ? UPSCALE_FILTER_NEAREST : UPSCALE_FILTER_BILINEAR;
+
+        i32 width = 1 + next_random(&seed) % ctx.output_width;
+        i32 height = 1 + next_random(&seed) % ctx.output_height;
+        // NOTE: Exact doubling has its own path
+        if (round % 4 < 2 && ctx.output_width % 2 == 0) {
+            width = ctx.output_width / 2;
+        }
+        set_render_resolution(&ctx, width, height, 1.0f);
+
+        for (i32 i = 0; i < width * height; ++i) {
+            ctx.buf[i] = (next_random(&seed) << 8) ^ next_random(&seed);
+        }
+
+        for (i32 y = 0; y < ctx.output_height; ++y) {
+            i32 src_y = get_upscale_source(y, height, ctx.output_height);
+            u32 *dst = expected + y * ctx.output_width;
+
+            if (ctx.filter == UPSCALE_FILTER_NEAREST) {
+                u32 *src = ctx.buf + ((src_y + (1 << 15)) >> 16) * width;
+                for (i32 x = 0; x < ctx.output_width; ++x) {
+                    i32 src_x = get_upscale_source(x, width, ctx.output_width);
+                    dst[x] = src[(src_x + (1 << 15)) >> 16];
+                }
+            } else {
+                u32 *top = ctx.buf + (src_y >> 16) * width;
+                u32 *bottom = (src_y >> 16) + 1 < height ? top + width : top;
+                for (i32 x = 0; x < width; ++x) {
+                    row[x] = lerp_u32(top[x], bottom[x], (src_y >> 8) & 0xFF);
+                }
+
+                for (i32 x = 0; x < ctx.output_width; ++x) {
+                    i32 src_x = get_upscale_source(x, width, ctx.output_width);
+                    i32 left = src_x >> 16;
+                    i32 right = left + 1 < width ? left + 1 : left;
+                    dst[x] = lerp_u32(row[left], row[right], (src_x >> 8) & 0xFF);
+                }
+            }
+        }
+
+        upscale_frame(&ctx);
+        check(memcmp(expected, ctx.present_buf,
+                     ctx.output_width * ctx.output_height * sizeof(u32)) == 0, round);
+    }
+
+    // NOTE: Every dynamic resolution level of the full resolution is rounded
+    for (u32 level = 0; level < count(dynamic_resolution_levels); ++level) {
+        f32 fraction = dynamic_resolution_levels[level];
+        check(scale_resolution(RENDER_WIDTH, fraction) == (i32)lround(RENDER_WIDTH * (f64)fraction) &&
+              scale_resolution(RENDER_HEIGHT, fraction) == (i32)lround(RENDER_HEIGHT * (f64)fraction),
+              level);
+    }
+}
+
+static void
+tick_game(game_state *gs, memory_arena *transient) {
+    reset_arena(transient);
+    tick_commands *commands = push_tick_commands(transient);
+    update_game(gs, commands, transient, 1.0f / 60.0f);
+}
+
+static int
+is_same_live_state(game_state *a, game_state *b) {
+    state_range ranges[MAX_STATE_RANGE_COUNT];
+    u32 range_count = get_game_state_ranges(a, ranges);
+
+    int result = 1;
+    for (u32 i = 0; i < range_count; ++i) {
+        result &= memcmp((u8 *)a + ranges[i].offset, (u8 *)b + ranges[i].offset,
+                         ranges[i].size) == 0;
+    }
+    return result;
+}
+
+static void
+push_game_state(rewind_buffer *rb, game_state *gs) {
+    state_range ranges[MAX_STATE_RANGE_COUNT];
+    u32 range_count = get_game_state_ranges(gs, ranges);
+    push_rewind_state(rb, gs, ranges, range_count);
+}
+
+// NOTE: Plays the game forward and walks the rewind buffer back, comparing
+// the live part of every state with a copy taken when it was pushed. Halfway
+// back the game is played forward again with the paddle moving, so the newer
+// history is replaced by a different one.
+static void
+check_rewind_round_trip(game_memory *memory) {
+    game_state *gs = push_struct(&memory->permanent, game_state);
+    init_game_state(gs);
+    init(gs, push_tick_commands(&memory->transient));
+
+    rewind_buffer *rb = push_struct(&memory->permanent, rewind_buffer);
+    init_rewind_buffer(rb, &memory->permanent, REWIND_BUFFER_SIZE, sizeof(game_state));
+    reset_rewind_buffer(rb, gs);
+
+    game_state *history = push_array(&memory->permanent, CHECK_TICK_COUNT + 1, game_state);
+    save_game_state(gs, history);
+
+    for (u32 tick = 1; tick <= CHECK_TICK_COUNT; ++tick) {
+        tick_game(gs, &memory->transient);
+        push_game_state(rb, gs);
+        save_game_state(gs, history + tick);
+    }
+
+    u32 tick = CHECK_TICK_COUNT;
+    for (; tick > CHECK_TICK_COUNT / 2; --tick) {
+        check(pop_rewind_state(rb, gs) && is_same_live_state(gs, history + tick - 1), tick);
+    }
+
+    for (; tick < CHECK_TICK_COUNT; ++tick) {
+        frame_input input = {};
+        input.flags = INPUT_FLAG_MOVE_PADDLE;
+        input.paddle_x = 100.0f + 2.0f * tick;
+        handle_input(gs, &input);
+
+        tick_game(gs, &memory->transient);
+        push_game_state(rb, gs);
+        save_game_state(gs, history + tick + 1);
+    }
+
+    for (; tick > 0; --tick) {
+        check(pop_rewind_state(rb, gs) && is_same_live_state(gs, history + tick - 1), tick);
+    }
+    check(!pop_rewind_state(rb, gs), 0);
+}
+
+// NOTE: Saves a run of states with their live ranges only and checks that a
+// reopened checkpoint resumes from the last one, unless the layout changed
+static void
+check_checkpoint_round_trip(game_memory *memory) {
+    unlink(TEST_CHECKPOINT_PATH);
+
+    game_state *gs = push_struct(&memory->permanent, game_state);
+    init_game_state(gs);
+    init(gs, push_tick_commands(&memory->transient));
+
+    u32 layout_hash = get_game_state_layout_hash();
+
+    checkpoint_file cp;
+    check(!open_checkpoint(&cp, TEST_CHECKPOINT_PATH, sizeof(game_state), layout_hash), 0);
+
+    for (u32 tick = 1; tick <= CHECK_TICK_COUNT; ++tick) {
+        tick_game(gs, &memory->transient);
+
+        state_range ranges[MAX_STATE_RANGE_COUNT];
+        u32 range_count = get_game_state_ranges(gs, ranges);
+        save_checkpoint(&cp, gs, ranges, range_count);
+    }
+    close_checkpoint(&cp);
+
+    check(open_checkpoint(&cp, TEST_CHECKPOINT_PATH, sizeof(game_state), layout_hash) &&
+          is_same_live_state(gs, get_checkpoint_state(&cp)) &&
+          !is_game_over(get_checkpoint_state(&cp)), CHECK_TICK_COUNT);
+    close_checkpoint(&cp);
+
+    check(!open_checkpoint(&cp, TEST_CHECKPOINT_PATH, sizeof(game_state), layout_hash + 1), 0);
+    close_checkpoint(&cp);
+
+    unlink(TEST_CHECKPOINT_PATH);
+}
+
+// NOTE: Global so the compiler cannot drop the timed work
+static vec2 bench_a[BENCH_COUNT];
+static vec2 bench_b[BENCH_COUNT];
+static vec4 bench_colors[BENCH_COUNT];
+static rect2 bench_rects[BENCH_COUNT];
+static u8 bench_overlaps[BENCH_COUNT];
+static u32 bench_u32_out[BENCH_COUNT];
+static u32 bench_pixels[BENCH_COUNT];
+
+// NOTE: Best of BENCH_RUN_COUNT runs of both versions, interleaved so both
+// see the same machine state
+#define BENCH(name, scalar_call, simd_call) \
+    do { \
+        u64 best_scalar = ~0ull; \
+        u64 best_simd = ~0ull; \
+        for (u32 run = 0; run < BENCH_RUN_COUNT; ++run) { \
+            u64 begin = SDL_GetPerformanceCounter(); \
+            scalar_call; \
+            u64 middle = SDL_GetPerformanceCounter(); \
+            simd_call; \
+            u64 end = SDL_GetPerformanceCounter(); \
+            if (middle - begin < best_scalar) { best_scalar = middle - begin; } \
+            if (end - middle < best_simd) { best_simd = end - middle; } \
+        } \
+        SDL_Log("%-22s %8.0f ns -> %8.0f ns\n", name, \
+                ticks_to_us(best_scalar) * 1000.0, ticks_to_us(best_simd) * 1000.0); \
+    } while (0)
+
+static void
+bench_batch_functions() {
+    u32 seed = 3;
+    fill_random_inputs(&seed, bench_a, bench_b, bench_colors, BENCH_COUNT);
+    rect2censize_n(bench_rects, bench_a, bench_b, BENCH_COUNT);
+
+    rect2 test = rect2censize(v2(400.0f, 300.0f), v2(200.0f, 150.0f));
+    u32 n = BENCH_COUNT;
+
+#if MATH_SSE2
+    const char *backend = "SSE2";
+#elif MATH_NEON
+    const char *backend = "NEON";
+#else
+    const char *backend = "scalar";
+#endif
+    SDL_Log("Best of %u runs, n = %u, scalar -> %s\n", BENCH_RUN_COUNT, n, backend);
+
+    BENCH("rect2censize_n",
+          rect2censize_n_scalar(bench_rects, bench_a, bench_b, n),
+          rect2censize_n(bench_rects, bench_a, bench_b, n));
+    BENCH("test_rect2_overlap_n",
+          test_rect2_overlap_n_scalar(bench_overlaps, test, bench_rects, n),
+          test_rect2_overlap_n(bench_overlaps, test, bench_rects, n));
+    BENCH("rgba_to_u32_n",
+          rgba_to_u32_n_scalar(bench_u32_out, bench_colors, n),
+          rgba_to_u32_n(bench_u32_out, bench_colors, n));
+
+    for (u32 i = 0; i < n; ++i) {
+        bench_pixels[i] = premultiply_u32(next_random_color(&seed));
+    }
+    BENCH("blend_premultiplied",
+          for (u32 i = 0; i < n; ++i) {
+              bench_u32_out[i] = blend_premultiplied_pixel(bench_u32_out[i], bench_pixels[i],
+                                                           BLEND_MODE_OVER);
+          },
+          blend_premultiplied_span(bench_u32_out, bench_pixels, 1, n, BLEND_MODE_OVER));
+}
+
+// NOTE: The snapshot work of every tick, a rewind push and a checkpoint save,
+// once over the whole state and once over the live ranges only. The game
+// runs between the ticks like it does in the frame loop, so the state is not
+// sitting in the cache.
+static void
+bench_snapshots(game_memory *memory) {
+    unlink(TEST_CHECKPOINT_PATH);
+
+    game_state *gs = push_struct(&memory->permanent, game_state);
+    init_game_state(gs);
+    init(gs, push_tick_commands(&memory->transient));
+
+    rewind_buffer *full_rb = push_struct(&memory->permanent, rewind_buffer);
+    init_rewind_buffer(full_rb, &memory->permanent, REWIND_BUFFER_SIZE, sizeof(game_state));
+    reset_rewind_buffer(full_rb, gs);
+
+    rewind_buffer *live_rb = push_struct(&memory->permanent, rewind_buffer);
+    init_rewind_buffer(live_rb, &memory->permanent, REWIND_BUFFER_SIZE, sizeof(game_state));
+    reset_rewind_buffer(live_rb, gs);
+
+    checkpoint_file cp;
+    open_checkpoint(&cp, TEST_CHECKPOINT_PATH, sizeof(game_state), get_game_state_layout_hash());
+
+    state_range full_range = { 0, sizeof(game_state) };
+
+    u64 full_ticks = 0;
+    u64 live_ticks = 0;
+    for (u32 tick = 0; tick < BENCH_TICK_COUNT; ++tick) {
+        tick_game(gs, &memory->transient);
+
+        u64 begin = SDL_GetPerformanceCounter();
+        push_rewind_state(full_rb, gs, &full_range, 1);
+        save_checkpoint(&cp, gs, &full_range, 1);
+        u64 middle = SDL_GetPerformanceCounter();
+
+        tick_game(gs, &memory->transient);
+
+        u64 live_begin = SDL_GetPerformanceCounter();
+        state_range ranges[MAX_STATE_RANGE_COUNT];
+        u32 range_count = get_game_state_ranges(gs, ranges);
+        push_rewind_state(live_rb, gs, ranges, range_count);
+        save_checkpoint(&cp, gs, ranges, range_count);
+        u64 end = SDL_GetPerformanceCounter();
+
+        full_ticks += middle - begin;
+        live_ticks += end - live_begin;
+    }
+
+    close_checkpoint(&cp);
+    unlink(TEST_CHECKPOINT_PATH);
+
+    SDL_Log("Mean of %u ticks, %u of %u entities live, whole state -> live ranges\n",
+            BENCH_TICK_COUNT, gs->entity_count, MAX_ENTITY_COUNT);
+    SDL_Log("%-22s %8.0f ns -> %8.0f ns\n", "rewind + checkpoint",
+            ticks_to_us(full_ticks) * 1000.0 / BENCH_TICK_COUNT,
+            ticks_to_us(live_ticks) * 1000.0 / BENCH_TICK_COUNT);
+}
+
+int
+main(void) {
+    SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
+
+    game_memory memory;
+    if (!init_game_memory(&memory, PERMANENT_MEMORY_SIZE, TRANSIENT_MEMORY_SIZE)) {
+        return 1;
+    }
+
+    check_batch_functions();
+    check_vec4_functions();
+    check_blend_functions();
+    check_mix_samples();
+    check_capture_encoding();
+    check_render_sprite(&memory);
+    check_upscale(&memory);
+    check_rewind_round_trip(&memory);
+    check_checkpoint_round_trip(&memory);
+
+    if (failed_check_count) {
+        logerr("%u checks failed\n", failed_check_count);
+        return 1;
+    }
+
+    SDL_Log("All checks passed\n");
+
+    bench_batch_functions();
+    bench_snapshots(&memory);
+
+    close_game_memory(&memory);
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+// NOTE: Columns of every glyph from left to right, bit 0 is the top row
+static u8 font_5x7[FONT_GLYPH_COUNT][FONT_GLYPH_WIDTH] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x00, 0x00, 0x5F, 0x00, 0x00 }, // '!'
+    { 0x00, 0x07, 0x00, 0x07, 0x00 }, // '"'
+    { 0x14, 0x7F, 0x14, 0x7F, 0x14 }, // '#'
+    { 0x24, 0x2A, 0x7F, 0x2A, 0x12 }, // '$'
+    { 0x23, 0x13, 0x08, 0x64, 0x62 }, // '%'
+    { 0x36, 0x49, 0x55, 0x22, 0x50 }, // '&'
+    { 0x00, 0x05, 0x03, 0x00, 0x00 }, // '''
+    { 0x00, 0x1C, 0x22, 0x41, 0x00 }, // '('
+    { 0x00, 0x41, 0x22, 0x1C, 0x00 }, // ')'
+    { 0x14, 0x08, 0x3E, 0x08, 0x14 }, // '*'
+    { 0x08, 0x08, 0x3E, 0x08, 0x08 }, // '+'
+    { 0x00, 0x50, 0x30, 0x00, 0x00 }, // ','
+    { 0x08, 0x08, 0x08, 0x08, 0x08 }, // '-'
+    { 0x00, 0x60, 0x60, 0x00, 0x00 }, // '.'
+    { 0x20, 0x10, 0x08, 0x04, 0x02 }, // '/'
+    { 0x3E, 0x51, 0x49, 0x45, 0x3E }, // '0'
+    { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // '1'
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, // '2'
+    { 0x21, 0x41, 0x45, 0x4B, 0x31 }, // '3'
+    { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // '4'
+    { 0x27, 0x45, 0x45, 0x45, 0x39 }, // '5'
+    { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, // '6'
+    { 0x01, 0x71, 0x09, 0x05, 0x03 }, // '7'
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, // '8'
+    { 0x06, 0x49, 0x49, 0x29, 0x1E }, // '9'
+    { 0x00, 0x36, 0x36, 0x00, 0x00 }, // ':'
+    { 0x00, 0x56, 0x36, 0x00, 0x00 }, // ';'
+    { 0x08, 0x14, 0x22, 0x41, 0x00 }, // '<'
+    { 0x14, 0x14, 0x14, 0x14, 0x14 }, // '='
+    { 0x00, 0x41, 0x22, 0x14, 0x08 }, // '>'
+    { 0x02, 0x01, 0x51, 0x09, 0x06 }, // '?'
+    { 0x32, 0x49, 0x79, 0x41, 0x3E }, // '@'
+    { 0x7E, 0x11, 0x11, 0x11, 0x7E }, // 'A'
+    { 0x7F, 0x49, 0x49, 0x49, 0x36 }, // 'B'
+    { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // 'C'
+    { 0x7F, 0x41, 0x41, 0x22, 0x1C }, // 'D'
+    { 0x7F, 0x49, 0x49, 0x49, 0x41 }, // 'E'
+    { 0x7F, 0x09, 0x09, 0x09, 0x01 }, // 'F'
+    { 0x3E, 0x41, 0x49, 0x49, 0x7A }, // 'G'
+    { 0x7F, 0x08, 0x08, 0x08, 0x7F }, // 'H'
+    { 0x00, 0x41, 0x7F, 0x41, 0x00 }, // 'I'
+    { 0x20, 0x40, 0x41, 0x3F, 0x01 }, // 'J'
+    { 0x7F, 0x08, 0x14, 0x22, 0x41 }, // 'K'
+    { 0x7F, 0x40, 0x40, 0x40, 0x40 }, // 'L'
+    { 0x7F, 0x02, 0x0C, 0x02, 0x7F }, // 'M'
+    { 0x7F, 0x04, 0x08, 0x10, 0x7F }, // 'N'
+    { 0x3E, 0x41, 0x41, 0x41, 0x3E }, // 'O'
+    { 0x7F, 0x09, 0x09, 0x09, 0x06 }, // 'P'
+    { 0x3E, 0x41, 0x51, 0x21, 0x5E }, // 'Q'
+    { 0x7F, 0x09, 0x19, 0x29, 0x46 }, // 'R'
+    { 0x46, 0x49, 0x49, 0x49, 0x31 }, // 'S'
+    { 0x01, 0x01, 0x7F, 0x01, 0x01 }, // 'T'
+    { 0x3F, 0x40, 0x40, 0x40, 0x3F }, // 'U'
+    { 0x1F, 0x20, 0x40, 0x20, 0x1F }, // 'V'
+    { 0x3F, 0x40, 0x38, 0x40, 0x3F }, // 'W'
+    { 0x63, 0x14, 0x08, 0x14, 0x63 }, // 'X'
+    { 0x07, 0x08, 0x70, 0x08, 0x07 }, // 'Y'
+    { 0x61, 0x51, 0x49, 0x45, 0x43 }, // 'Z'
+};
+
+static void
+init_font(font *f, memory_arena *arena, i32 scale, vec4 foreground, vec4 background) {
+    *f = (font) {};
+
+    f->scale = scale;
+    f->cell_width = FONT_CELL_WIDTH * scale;
+    f->cell_height = FONT_CELL_HEIGHT * scale;
+    f->atlas_width = FONT_GLYPH_COUNT * f->cell_width;
+    f->atlas = push_array(arena, f->atlas_width * f->cell_height, u32);
+
+    u32 fg = rgba_to_u32(foreground);
+    u32 bg = rgba_to_u32(background);
+
+    // NOTE: Atlas rows are stored top row first, like sprites
+    for (i32 glyph = 0; glyph < FONT_GLYPH_COUNT; ++glyph) {
+        for (i32 y = 0; y < f->cell_height; ++y) {
+            u32 *pixel = f->atlas + y * f->atlas_width + glyph * f->cell_width;
+            i32 glyph_y = y / scale;
+
+            for (i32 x = 0; x < f->cell_width; ++x) {
+                i32 glyph_x = x / scale;
+
+                u32 color = bg;
+                if (glyph_x < FONT_GLYPH_WIDTH && glyph_y < FONT_GLYPH_HEIGHT &&
+                    (font_5x7[glyph][glyph_x] & (1 << glyph_y)))
+                {
+                    color = fg;
+                }
+                *pixel++ = color;
+            }
+        }
+    }
+}
+
+static i32
+get_glyph_index(char c) {
+    if (c >= 'a' && c <= 'z') {
+        c = c - 'a' + 'A';
+    }
+
+    if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR) {
+        c = '?';
+    }
+
+    i32 result = c - FONT_FIRST_CHAR;
+    return result;
+}
+
+static void
+init_text_layout(text_layout *layout, memory_arena *arena, font *f) {
+    *layout = (text_layout) {};
+
+    layout->pixels = push_array(arena, TEXT_MAX_LENGTH * f->cell_width * f->cell_height, u32);
+}
+
+// NOTE: Returns 1 if the text changed and the layout was rasterized again
+static int
+set_text(text_layout *layout, font *f, const char *text) {
+    u32 length = strlen(text);
+    if (length > TEXT_MAX_LENGTH) {
+        length = TEXT_MAX_LENGTH;
+    }
+
+    if (length == layout->length && memcmp(layout->text, text, length) == 0) {
+        return 0;
+    }
+
+    memcpy(layout->text, text, length);
+    layout->text[length] = 0;
+    layout->length = length;
+
+    layout->width = length * f->cell_width;
+    layout->height = f->cell_height;
+
+    for (u32 i = 0; i < length; ++i) {
+        u32 *src = f->atlas + get_glyph_index(text[i]) * f->cell_width;
+        u32 *dst = layout->pixels + i * f->cell_width;
+
+        for (i32 y = 0; y < f->cell_height; ++y) {
+            memcpy(dst, src, f->cell_width * sizeof(u32));
+            src += f->atlas_width;
+            dst += layout->width;
+        }
+    }
+
+    return 1;
+}
+
+// NOTE: Draws the layout with its bottom left corner at pos. Text is laid
+// out in pixels, pos is too. The atlas is premultiplied, so every row is
+// blended over what is below and only the glyphs themselves cover it.
+static void
+render_text(render_context *ctx, text_layout *layout, vec2 pos) {
+    i32 rminx = (i32)pos.x;
+    i32 rminy = (i32)pos.y;
+    i32 rmaxy = rminy + layout->height;
+
+    i32 minx = rminx;
+    i32 miny = rminy;
+    i32 maxx = rminx + layout->width;
+    i32 maxy = rmaxy;
+
+    if (minx < 0) { minx = 0; }
+    if (maxx >= ctx->width) { maxx = ctx->width; }
+    if (miny < 0) { miny = 0; }
+    if (maxy >= ctx->height) { maxy = ctx->height; }
+
+    if (minx >= maxx || miny >= maxy) {
+        return;
+    }
+
+    u32 *row = ctx->buf + (ctx->height - 1 - (maxy - 1)) * ctx->width + minx;
+    u32 *src = layout->pixels + (rmaxy - maxy) * layout->width + (minx - rminx);
+    for (i32 y = maxy - 1; y >= miny; --y) {
+        blend_premultiplied_span(row, src, 1, maxx - minx, BLEND_MODE_OVER);
+        row += ctx->width;
+        src += layout->width;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+// NOTE: Built-in 5x7 font covering ' ' to 'Z', lowercase letters are drawn
+// as uppercase
+#define FONT_FIRST_CHAR ' '
+#define FONT_LAST_CHAR 'Z'
+#define FONT_GLYPH_COUNT (FONT_LAST_CHAR - FONT_FIRST_CHAR + 1)
+#define FONT_GLYPH_WIDTH 5
+#define FONT_GLYPH_HEIGHT 7
+// NOTE: One column and one row of spacing around every glyph
+#define FONT_CELL_WIDTH (FONT_GLYPH_WIDTH + 1)
+#define FONT_CELL_HEIGHT (FONT_GLYPH_HEIGHT + 1)
+
+#define TEXT_MAX_LENGTH 48
+
+// NOTE: Glyphs are rasterized once, scaled and with the foreground and
+// background colors baked in, into an atlas of cells laid out side by side.
+typedef struct {
+    u32 *atlas;
+    i32 atlas_width;
+    i32 scale;
+    i32 cell_width;
+    i32 cell_height;
+} font;
+
+// NOTE: A string rendered with a font. The pixels are only rasterized again
+// when the text changes, drawing it is one copy per row.
+typedef struct {
+    char text[TEXT_MAX_LENGTH + 1];
+    u32 length;
+
+    u32 *pixels;
+    i32 width;
+    i32 height;
+} text_layout;
+
+#endif
@@ -0,0 +1,24 @@
+#!/bin/sh
+
+cc=clang
+src=`pwd`/src/tests.c
+
+[ ! -d "build" ] && mkdir build
+
+pushd build
+
+# NOTE: Once with the SIMD backend of the machine and once with the scalar
+# fallback, both must pass. The tests include whole game sources and only use
+# a few of their functions.
+flags="-std=c11 -W -Wall -Wno-unused-function -g -O2"
+
+$cc -o tests $flags $src -lSDL2 &&
+$cc -o tests_no_simd $flags -DMATH_NO_SIMD $src -lSDL2 &&
+./tests &&
+./tests_no_simd
+
+success=$?
+
+popd
+
+exit $success